@@ -0,0 +1,70 @@
+#pragma once
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <cstddef>
+
+namespace solver
+{
+	// scratch memory of one request: allocation bumps a pointer, deallocation does nothing and reset() frees all at once.
+	// memory comes from owned block, what does not fit goes to heap and next reset() grows the block by that much,
+	// so after the first few requests of a kind compiling does not touch global heap at all.
+	// not thread safe, every thread needs its own arena
+	class arena
+	{
+		// heap behind the block, counts what block could not hold
+		class overflow_resource final : public std::pmr::memory_resource {
+			size_t _bytes{ 0 };
+			size_t _count{ 0 };
+
+			void* do_allocate(const size_t bytes, const size_t align) override {
+				_bytes += bytes;
+				++_count;
+				return std::pmr::new_delete_resource()->allocate(bytes, align);
+			}
+			void do_deallocate(void* p, const size_t bytes, const size_t align) override {
+				std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+			}
+			bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+
+		public:
+			[[nodiscard]] size_t bytes() const { return _bytes; }
+			[[nodiscard]] size_t count() const { return _count; }
+			void clear_bytes() { _bytes = 0; }
+		};
+
+		std::unique_ptr<std::byte[]> _block;
+		size_t _capacity;
+		overflow_resource _overflow;
+		std::optional<std::pmr::monotonic_buffer_resource> _resource;
+
+	public:
+		explicit arena(const size_t capacity = 64 * 1024) :
+			_block(std::make_unique_for_overwrite<std::byte[]>(capacity)), _capacity(capacity) {
+			_resource.emplace(_block.get(), _capacity, &_overflow);
+		}
+
+		arena(const arena&) = delete;
+		arena& operator=(const arena&) = delete;
+
+		[[nodiscard]] std::pmr::memory_resource* resource() { return &*_resource; }
+
+		// everything allocated so far is gone, containers using resource must not outlive this call
+		void reset() {
+			if (_overflow.bytes() == 0) {
+				_resource->release();
+				return;
+			}
+			_capacity += _overflow.bytes();
+			_overflow.clear_bytes();
+			_resource.reset();
+			_block = std::make_unique_for_overwrite<std::byte[]>(_capacity);
+			_resource.emplace(_block.get(), _capacity, &_overflow);
+		}
+
+		[[nodiscard]] size_t capacity() const { return _capacity; }
+
+		// times block was too small since construction
+		[[nodiscard]] size_t overflows() const { return _overflow.count(); }
+	};
+}
@@ -0,0 +1,506 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <variant>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SOLVER_BATCH_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// msvc emits any intrinsic without per-function target
+#define SOLVER_TARGET(isa)
+#else
+#define SOLVER_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+#include "compiled_expression.h"
+
+namespace solver::batch
+{
+	// rows run through program at once, registers of one block stay in L1 cache
+	inline constexpr size_t block = 128;
+
+	// boolean register lane, all bits set when true so it works as blend mask
+	using mask_t = uint64_t;
+
+	// kernels running blocks, later ones are faster and need newer cpu
+	enum class isa { scalar, avx2, avx512 };
+
+	namespace detail {
+		using vm::op_code;
+
+		[[nodiscard]] constexpr mask_t lane(const bool v) { return v ? ~mask_t{ 0 } : mask_t{ 0 }; }
+
+		// every kernel set has the same block level functions, operands are registers of block rows.
+		// destination may be one of operands, each lane is read before it is written
+		struct scalar_kernels {
+			template<op_code C>
+			static num_t apply(const num_t a, const num_t b) {
+				if constexpr (C == op_code::add) return a + b;
+				else if constexpr (C == op_code::sub) return a - b;
+				else if constexpr (C == op_code::mul) return a * b;
+				else if constexpr (C == op_code::div) return a / b;
+				else if constexpr (C == op_code::min) return b < a ? b : a;
+				else return a < b ? b : a;
+			}
+
+			template<op_code C>
+			static bool test(const num_t a, const num_t b) {
+				if constexpr (C == op_code::lt) return a < b;
+				else if constexpr (C == op_code::le) return a <= b;
+				else if constexpr (C == op_code::gt) return a > b;
+				else if constexpr (C == op_code::ge) return a >= b;
+				else return a == b;
+			}
+
+			template<op_code C>
+			static void binary(num_t* d, const num_t* a, const num_t* b) {
+				for (size_t r = 0; r < block; ++r) d[r] = apply<C>(a[r], b[r]);
+			}
+
+			// imm as right operand, or left one when reversed
+			template<op_code C, bool reversed>
+			static void binary_imm(num_t* d, const num_t* a, const num_t imm) {
+				for (size_t r = 0; r < block; ++r) d[r] = reversed ? apply<C>(imm, a[r]) : apply<C>(a[r], imm);
+			}
+
+			static void fma(num_t* d, const num_t* a, const num_t* b, const num_t* c) {
+				for (size_t r = 0; r < block; ++r) d[r] = std::fma(a[r], b[r], c[r]);
+			}
+
+			static void sqrt(num_t* d, const num_t* a) {
+				for (size_t r = 0; r < block; ++r) d[r] = vm::half_power(a[r]);
+			}
+
+			static void neg(num_t* d, const num_t* a) {
+				for (size_t r = 0; r < block; ++r) d[r] = -a[r];
+			}
+
+			template<op_code C>
+			static void compare(mask_t* d, const num_t* a, const num_t* b) {
+				for (size_t r = 0; r < block; ++r) d[r] = lane(test<C>(a[r], b[r]));
+			}
+
+			template<op_code C>
+			static void logic(mask_t* d, const mask_t* a, const mask_t* b) {
+				for (size_t r = 0; r < block; ++r) {
+					if constexpr (C == op_code::logic_and) d[r] = a[r] & b[r];
+					else if constexpr (C == op_code::logic_or) d[r] = a[r] | b[r];
+					else d[r] = a[r] ^ b[r];
+				}
+			}
+
+			static void select(num_t* d, const mask_t* m, const num_t* x, const num_t* y) {
+				for (size_t r = 0; r < block; ++r) d[r] = m[r] ? x[r] : y[r];
+			}
+
+			template<op_code C>
+			static void select_cmp(num_t* d, const num_t* a, const num_t* b, const num_t* x, const num_t* y) {
+				for (size_t r = 0; r < block; ++r) d[r] = test<C>(a[r], b[r]) ? x[r] : y[r];
+			}
+		};
+
+#if SOLVER_BATCH_X64
+		// _CMP_ predicate of comparison, ordered and quiet: false on NaN like C++ operators
+		template<op_code C>
+		inline constexpr int predicate = C == op_code::lt ? _CMP_LT_OQ : C == op_code::le ? _CMP_LE_OQ :
+			C == op_code::gt ? _CMP_GT_OQ : C == op_code::ge ? _CMP_GE_OQ : _CMP_EQ_OQ;
+
+		struct avx2_kernels {
+			template<op_code C>
+			SOLVER_TARGET("avx2,fma") static __m256d apply(const __m256d a, const __m256d b) {
+				if constexpr (C == op_code::add) return _mm256_add_pd(a, b);
+				else if constexpr (C == op_code::sub) return _mm256_sub_pd(a, b);
+				else if constexpr (C == op_code::mul) return _mm256_mul_pd(a, b);
+				else if constexpr (C == op_code::div) return _mm256_div_pd(a, b);
+				// minpd(x, y) is x < y ? x : y, so operands swapped give vm results for NaN and signed zeros
+				else if constexpr (C == op_code::min) return _mm256_min_pd(b, a);
+				else return _mm256_max_pd(b, a);
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx2,fma") static void binary(num_t* d, const num_t* a, const num_t* b) {
+				for (size_t r = 0; r < block; r += 4)
+					_mm256_storeu_pd(d + r, apply<C>(_mm256_loadu_pd(a + r), _mm256_loadu_pd(b + r)));
+			}
+
+			template<op_code C, bool reversed>
+			SOLVER_TARGET("avx2,fma") static void binary_imm(num_t* d, const num_t* a, const num_t imm) {
+				const __m256d c = _mm256_set1_pd(imm);
+				for (size_t r = 0; r < block; r += 4) {
+					const __m256d x = _mm256_loadu_pd(a + r);
+					_mm256_storeu_pd(d + r, reversed ? apply<C>(c, x) : apply<C>(x, c));
+				}
+			}
+
+			SOLVER_TARGET("avx2,fma") static void fma(num_t* d, const num_t* a, const num_t* b, const num_t* c) {
+				for (size_t r = 0; r < block; r += 4)
+					_mm256_storeu_pd(d + r, _mm256_fmadd_pd(_mm256_loadu_pd(a + r), _mm256_loadu_pd(b + r), _mm256_loadu_pd(c + r)));
+			}
+
+			// vm::half_power
+			SOLVER_TARGET("avx2,fma") static void sqrt(num_t* d, const num_t* a) {
+				const __m256d zero = _mm256_setzero_pd(), inf = _mm256_set1_pd(std::numeric_limits<num_t>::infinity()), minus_inf = _mm256_set1_pd(-std::numeric_limits<num_t>::infinity());
+				for (size_t r = 0; r < block; r += 4) {
+					const __m256d x = _mm256_loadu_pd(a + r);
+					_mm256_storeu_pd(d + r, _mm256_blendv_pd(_mm256_sqrt_pd(_mm256_add_pd(x, zero)), inf, _mm256_cmp_pd(x, minus_inf, _CMP_EQ_OQ)));
+				}
+			}
+
+			SOLVER_TARGET("avx2,fma") static void neg(num_t* d, const num_t* a) {
+				const __m256d sign = _mm256_set1_pd(-0.0);
+				for (size_t r = 0; r < block; r += 4)
+					_mm256_storeu_pd(d + r, _mm256_xor_pd(_mm256_loadu_pd(a + r), sign));
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx2,fma") static void compare(mask_t* d, const num_t* a, const num_t* b) {
+				for (size_t r = 0; r < block; r += 4)
+					_mm256_storeu_pd(reinterpret_cast<double*>(d + r), _mm256_cmp_pd(_mm256_loadu_pd(a + r), _mm256_loadu_pd(b + r), predicate<C>));
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx2,fma") static void logic(mask_t* d, const mask_t* a, const mask_t* b) {
+				for (size_t r = 0; r < block; r += 4) {
+					const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + r));
+					const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + r));
+					__m256i z;
+					if constexpr (C == op_code::logic_and) z = _mm256_and_si256(x, y);
+					else if constexpr (C == op_code::logic_or) z = _mm256_or_si256(x, y);
+					else z = _mm256_xor_si256(x, y);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(d + r), z);
+				}
+			}
+
+			SOLVER_TARGET("avx2,fma") static void select(num_t* d, const mask_t* m, const num_t* x, const num_t* y) {
+				for (size_t r = 0; r < block; r += 4) {
+					const __m256d k = _mm256_loadu_pd(reinterpret_cast<const double*>(m + r));
+					_mm256_storeu_pd(d + r, _mm256_blendv_pd(_mm256_loadu_pd(y + r), _mm256_loadu_pd(x + r), k));
+				}
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx2,fma") static void select_cmp(num_t* d, const num_t* a, const num_t* b, const num_t* x, const num_t* y) {
+				for (size_t r = 0; r < block; r += 4) {
+					const __m256d k = _mm256_cmp_pd(_mm256_loadu_pd(a + r), _mm256_loadu_pd(b + r), predicate<C>);
+					_mm256_storeu_pd(d + r, _mm256_blendv_pd(_mm256_loadu_pd(y + r), _mm256_loadu_pd(x + r), k));
+				}
+			}
+		};
+
+		// avx512f only, no dq or vl, so any avx-512 cpu runs it
+		struct avx512_kernels {
+			template<op_code C>
+			SOLVER_TARGET("avx512f") static __m512d apply(const __m512d a, const __m512d b) {
+				if constexpr (C == op_code::add) return _mm512_add_pd(a, b);
+				else if constexpr (C == op_code::sub) return _mm512_sub_pd(a, b);
+				else if constexpr (C == op_code::mul) return _mm512_mul_pd(a, b);
+				else if constexpr (C == op_code::div) return _mm512_div_pd(a, b);
+				// maskz forms with full mask, plain min, max and sqrt trip -Wuninitialized in gcc 12 headers
+				else if constexpr (C == op_code::min) return _mm512_maskz_min_pd(0xFF, b, a);
+				else return _mm512_maskz_max_pd(0xFF, b, a);
+			}
+
+			SOLVER_TARGET("avx512f") static __mmask8 to_mask(const mask_t* m) {
+				const __m512i v = _mm512_loadu_si512(m);
+				return _mm512_test_epi64_mask(v, v);
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx512f") static void binary(num_t* d, const num_t* a, const num_t* b) {
+				for (size_t r = 0; r < block; r += 8)
+					_mm512_storeu_pd(d + r, apply<C>(_mm512_loadu_pd(a + r), _mm512_loadu_pd(b + r)));
+			}
+
+			template<op_code C, bool reversed>
+			SOLVER_TARGET("avx512f") static void binary_imm(num_t* d, const num_t* a, const num_t imm) {
+				const __m512d c = _mm512_set1_pd(imm);
+				for (size_t r = 0; r < block; r += 8) {
+					const __m512d x = _mm512_loadu_pd(a + r);
+					_mm512_storeu_pd(d + r, reversed ? apply<C>(c, x) : apply<C>(x, c));
+				}
+			}
+
+			SOLVER_TARGET("avx512f") static void fma(num_t* d, const num_t* a, const num_t* b, const num_t* c) {
+				for (size_t r = 0; r < block; r += 8)
+					_mm512_storeu_pd(d + r, _mm512_fmadd_pd(_mm512_loadu_pd(a + r), _mm512_loadu_pd(b + r), _mm512_loadu_pd(c + r)));
+			}
+
+			// vm::half_power
+			SOLVER_TARGET("avx512f") static void sqrt(num_t* d, const num_t* a) {
+				const __m512d zero = _mm512_setzero_pd(), inf = _mm512_set1_pd(std::numeric_limits<num_t>::infinity()), minus_inf = _mm512_set1_pd(-std::numeric_limits<num_t>::infinity());
+				for (size_t r = 0; r < block; r += 8) {
+					const __m512d x = _mm512_loadu_pd(a + r);
+					const __m512d root = _mm512_maskz_sqrt_pd(0xFF, _mm512_add_pd(x, zero));
+					_mm512_storeu_pd(d + r, _mm512_mask_mov_pd(root, _mm512_cmp_pd_mask(x, minus_inf, _CMP_EQ_OQ), inf));
+				}
+			}
+
+			SOLVER_TARGET("avx512f") static void neg(num_t* d, const num_t* a) {
+				const __m512i sign = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull));
+				for (size_t r = 0; r < block; r += 8)
+					_mm512_storeu_si512(d + r, _mm512_xor_si512(_mm512_loadu_si512(a + r), sign));
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx512f") static void compare(mask_t* d, const num_t* a, const num_t* b) {
+				for (size_t r = 0; r < block; r += 8) {
+					const __mmask8 k = _mm512_cmp_pd_mask(_mm512_loadu_pd(a + r), _mm512_loadu_pd(b + r), predicate<C>);
+					_mm512_storeu_si512(d + r, _mm512_maskz_set1_epi64(k, -1));
+				}
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx512f") static void logic(mask_t* d, const mask_t* a, const mask_t* b) {
+				for (size_t r = 0; r < block; r += 8) {
+					const __m512i x = _mm512_loadu_si512(a + r);
+					const __m512i y = _mm512_loadu_si512(b + r);
+					__m512i z;
+					if constexpr (C == op_code::logic_and) z = _mm512_and_si512(x, y);
+					else if constexpr (C == op_code::logic_or) z = _mm512_or_si512(x, y);
+					else z = _mm512_xor_si512(x, y);
+					_mm512_storeu_si512(d + r, z);
+				}
+			}
+
+			SOLVER_TARGET("avx512f") static void select(num_t* d, const mask_t* m, const num_t* x, const num_t* y) {
+				for (size_t r = 0; r < block; r += 8)
+					_mm512_storeu_pd(d + r, _mm512_mask_blend_pd(to_mask(m + r), _mm512_loadu_pd(y + r), _mm512_loadu_pd(x + r)));
+			}
+
+			template<op_code C>
+			SOLVER_TARGET("avx512f") static void select_cmp(num_t* d, const num_t* a, const num_t* b, const num_t* x, const num_t* y) {
+				for (size_t r = 0; r < block; r += 8) {
+					const __mmask8 k = _mm512_cmp_pd_mask(_mm512_loadu_pd(a + r), _mm512_loadu_pd(b + r), predicate<C>);
+					_mm512_storeu_pd(d + r, _mm512_mask_blend_pd(k, _mm512_loadu_pd(y + r), _mm512_loadu_pd(x + r)));
+				}
+			}
+		};
+#endif
+
+		// one block of rows through branchless program, same effect per row as vm::execute.
+		// v[s] + row are values of slot s for the block, n and b hold block values of every register.
+		// dispatch is paid once per instruction and block, function calls still go lane by lane
+		template<typename K>
+		void run_block(std::span<const vm::instruction> program, const num_t* const* v, const size_t row, num_t* n, mask_t* b) {
+			const auto N = [n](const uint32_t r) { return n + size_t{ r } * block; };
+			const auto B = [b](const uint32_t r) { return b + size_t{ r } * block; };
+			const auto V = [v, row](const uint32_t s) { return v[s] + row; };
+
+			for (const vm::instruction& i : program) {
+				switch (i.code) {
+					case op_code::ld_const:  std::fill_n(N(i.dst), block, i.imm); break;
+					case op_code::ld_var:    std::copy_n(V(i.a), block, N(i.dst)); break;
+					case op_code::ld_bool:   std::fill_n(B(i.dst), block, lane(i.imm != num_t{ 0 })); break;
+					case op_code::neg:       K::neg(N(i.dst), N(i.a)); break;
+					case op_code::add:       K::template binary<op_code::add>(N(i.dst), N(i.a), N(i.b)); break;
+					case op_code::sub:       K::template binary<op_code::sub>(N(i.dst), N(i.a), N(i.b)); break;
+					case op_code::mul:       K::template binary<op_code::mul>(N(i.dst), N(i.a), N(i.b)); break;
+					case op_code::div:       K::template binary<op_code::div>(N(i.dst), N(i.a), N(i.b)); break;
+					case op_code::add_rc:    K::template binary_imm<op_code::add, false>(N(i.dst), N(i.a), i.imm); break;
+					case op_code::sub_rc:    K::template binary_imm<op_code::sub, false>(N(i.dst), N(i.a), i.imm); break;
+					case op_code::sub_cr:    K::template binary_imm<op_code::sub, true>(N(i.dst), N(i.a), i.imm); break;
+					case op_code::mul_rc:    K::template binary_imm<op_code::mul, false>(N(i.dst), N(i.a), i.imm); break;
+					case op_code::div_rc:    K::template binary_imm<op_code::div, false>(N(i.dst), N(i.a), i.imm); break;
+					case op_code::div_cr:    K::template binary_imm<op_code::div, true>(N(i.dst), N(i.a), i.imm); break;
+					case op_code::add_vc:    K::template binary_imm<op_code::add, false>(N(i.dst), V(i.a), i.imm); break;
+					case op_code::sub_vc:    K::template binary_imm<op_code::sub, false>(N(i.dst), V(i.a), i.imm); break;
+					case op_code::sub_cv:    K::template binary_imm<op_code::sub, true>(N(i.dst), V(i.a), i.imm); break;
+					case op_code::mul_vc:    K::template binary_imm<op_code::mul, false>(N(i.dst), V(i.a), i.imm); break;
+					case op_code::div_vc:    K::template binary_imm<op_code::div, false>(N(i.dst), V(i.a), i.imm); break;
+					case op_code::div_cv:    K::template binary_imm<op_code::div, true>(N(i.dst), V(i.a), i.imm); break;
+					case op_code::fma:       K::fma(N(i.dst), N(i.a), N(i.b), N(i.c)); break;
+					case op_code::sqrt:      K::sqrt(N(i.dst), N(i.a)); break;
+					case op_code::min:       K::template binary<op_code::min>(N(i.dst), N(i.a), N(i.b)); break;
+					case op_code::max:       K::template binary<op_code::max>(N(i.dst), N(i.a), N(i.b)); break;
+					// functions are pure, so one call serves whole block
+					case op_code::call0:     std::fill_n(N(i.dst), block, i.fn.f0()); break;
+					case op_code::call1: {
+						num_t* d = N(i.dst);
+						const num_t* a = N(i.a);
+						for (size_t r = 0; r < block; ++r) d[r] = i.fn.f1(a[r]);
+						break;
+					}
+					case op_code::call1_v: {
+						num_t* d = N(i.dst);
+						const num_t* a = V(i.a);
+						for (size_t r = 0; r < block; ++r) d[r] = i.fn.f1(a[r]);
+						break;
+					}
+					case op_code::call2: {
+						num_t* d = N(i.dst);
+						const num_t* a = N(i.a);
+						const num_t* c = N(i.b);
+						for (size_t r = 0; r < block; ++r) d[r] = i.fn.f2(a[r], c[r]);
+						break;
+					}
+					case op_code::lt:        K::template compare<op_code::lt>(B(i.dst), N(i.a), N(i.b)); break;
+					case op_code::le:        K::template compare<op_code::le>(B(i.dst), N(i.a), N(i.b)); break;
+					case op_code::gt:        K::template compare<op_code::gt>(B(i.dst), N(i.a), N(i.b)); break;
+					case op_code::ge:        K::template compare<op_code::ge>(B(i.dst), N(i.a), N(i.b)); break;
+					case op_code::eq:        K::template compare<op_code::eq>(B(i.dst), N(i.a), N(i.b)); break;
+					case op_code::logic_and: K::template logic<op_code::logic_and>(B(i.dst), B(i.a), B(i.b)); break;
+					case op_code::logic_or:  K::template logic<op_code::logic_or>(B(i.dst), B(i.a), B(i.b)); break;
+					case op_code::logic_xor: K::template logic<op_code::logic_xor>(B(i.dst), B(i.a), B(i.b)); break;
+					case op_code::select:    K::select(N(i.dst), B(i.a), N(i.b), N(i.c)); break;
+					case op_code::select_lt: K::template select_cmp<op_code::lt>(N(i.dst), N(i.a), N(i.b), N(i.c), N(i.e)); break;
+					case op_code::select_le: K::template select_cmp<op_code::le>(N(i.dst), N(i.a), N(i.b), N(i.c), N(i.e)); break;
+					case op_code::select_gt: K::template select_cmp<op_code::gt>(N(i.dst), N(i.a), N(i.b), N(i.c), N(i.e)); break;
+					case op_code::select_ge: K::template select_cmp<op_code::ge>(N(i.dst), N(i.a), N(i.b), N(i.c), N(i.e)); break;
+					case op_code::select_eq: K::template select_cmp<op_code::eq>(N(i.dst), N(i.a), N(i.b), N(i.c), N(i.e)); break;
+					case op_code::mov:       std::copy_n(N(i.a), block, N(i.dst)); break;
+					case op_code::bmov:      std::copy_n(B(i.a), block, B(i.dst)); break;
+					// jumps never reach here, programs with them run row by row
+					default: break;
+				}
+			}
+		}
+
+		using runner_t = void(*)(std::span<const vm::instruction>, const num_t* const*, size_t, num_t*, mask_t*);
+
+		[[nodiscard]] inline runner_t runner(const isa kernels) {
+#if SOLVER_BATCH_X64
+			if (kernels == isa::avx512) return &run_block<avx512_kernels>;
+			if (kernels == isa::avx2) return &run_block<avx2_kernels>;
+#endif
+			return &run_block<scalar_kernels>;
+		}
+
+		[[nodiscard]] inline bool has_jumps(std::span<const vm::instruction> program) {
+			return std::ranges::any_of(program, [](const vm::instruction& i) { return i.code >= op_code::jump; });
+		}
+
+		[[nodiscard]] inline isa probe() {
+#if SOLVER_BATCH_X64
+#if defined(_MSC_VER) && !defined(__clang__)
+			int r[4];
+			__cpuid(r, 0);
+			if (r[0] < 7) return isa::scalar;
+			__cpuid(r, 1);
+			const bool fma = (r[2] & (1 << 12)) != 0;
+			// os saves ymm (and zmm) registers on context switch
+			if ((r[2] & (1 << 27)) == 0 || (r[2] & (1 << 28)) == 0) return isa::scalar;
+			const unsigned long long xcr0 = _xgetbv(0);
+			if ((xcr0 & 0x6) != 0x6) return isa::scalar;
+			__cpuidex(r, 7, 0);
+			if ((r[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6) return isa::avx512;
+			if ((r[1] & (1 << 5)) != 0 && fma) return isa::avx2;
+#else
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f")) return isa::avx512;
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return isa::avx2;
+#endif
+#endif
+			return isa::scalar;
+		}
+
+		// feeds sink(row, count, num result, boolean result) block by block, result of the other type is nullptr
+		template<typename Sink>
+		std::variant<std::monostate, error> run(const compiled_expression& ce, std::span<const std::span<const num_t>> columns,
+			const size_t rows, const isa kernels, Sink&& sink) {
+			if (columns.size() < ce.n_slots()) return error::out_of_range;
+			const std::vector<size_t> used = ce.used_slots();
+			for (const size_t s : used) {
+				if (columns[s].size() < rows) return error::out_of_range;
+			}
+			const bool is_num = ce.result_type() == value_type::num;
+
+			if (has_jumps(ce.program())) {
+				// compiled without compile_options::branchless, rows go through vm one by one
+				std::vector<num_t> vars(ce.n_slots());
+				std::vector<num_t> num(is_num ? block : 0);
+				std::vector<mask_t> mask(is_num ? 0 : block);
+				vm::registers regs;
+				for (size_t row = 0; row < rows; row += block) {
+					const size_t count = std::min(block, rows - row);
+					for (size_t r = 0; r < count; ++r) {
+						for (const size_t s : used) vars[s] = columns[s][row + r];
+						const auto res = ce.evaluate(vars, regs);
+						if (is_num) num[r] = std::get<num_t>(res);
+						else mask[r] = lane(std::get<bool_t>(res));
+					}
+					sink(row, count, is_num ? num.data() : nullptr, is_num ? nullptr : mask.data());
+				}
+				return std::monostate{};
+			}
+
+			std::vector<num_t> num(size_t{ ce.n_num() } * block);
+			std::vector<mask_t> mask(size_t{ ce.n_bool() } * block);
+			const num_t* const num_result = is_num ? num.data() + size_t{ ce.result_reg() } * block : nullptr;
+			const mask_t* const mask_result = is_num ? nullptr : mask.data() + size_t{ ce.result_reg() } * block;
+			std::vector<const num_t*> vars(ce.n_slots(), nullptr);
+			for (const size_t s : used) vars[s] = columns[s].data();
+			const runner_t run_block = runner(kernels);
+
+			const size_t full = rows - rows % block;
+			for (size_t row = 0; row < full; row += block) {
+				run_block(ce.program(), vars.data(), row, num.data(), mask.data());
+				sink(row, block, num_result, mask_result);
+			}
+			if (full < rows) {
+				// last rows are copied to zero padded block, so kernels never read past end of columns
+				const size_t count = rows - full;
+				std::vector<num_t> tail(used.size() * block, num_t{ 0 });
+				for (size_t k = 0; k < used.size(); ++k) {
+					std::copy_n(columns[used[k]].data() + full, count, tail.data() + k * block);
+					vars[used[k]] = tail.data() + k * block;
+				}
+				run_block(ce.program(), vars.data(), 0, num.data(), mask.data());
+				sink(full, count, num_result, mask_result);
+			}
+			return std::monostate{};
+		}
+	}
+
+	// best kernels this cpu and os support, detected once
+	[[nodiscard]] inline isa detect() {
+		static const isa best = detail::probe();
+		return best;
+	}
+
+	// evaluates expression for every row of columnar data, columns[s] holding values of slot s for all rows.
+	// only slots program reads are looked at, others may be empty. results are the same as evaluate() row by row, up to sign of NaN.
+	// expressions compiled with compile_options::branchless run block by block, others fall back to vm per row.
+	// kernels newer than detect() are not used even when asked for
+	[[nodiscard]] inline std::variant<std::monostate, error> evaluate(const compiled_expression& ce,
+		std::span<const std::span<const num_t>> columns, std::span<num_t> out, const isa kernels = detect()) {
+		if (ce.result_type() != value_type::num) return error::wrong_type;
+		return detail::run(ce, columns, out.size(), std::min(kernels, detect()),
+			[out](const size_t row, const size_t count, const num_t* num, const mask_t*) { std::copy_n(num, count, out.data() + row); });
+	}
+
+	// boolean result as column of 0 and 1
+	[[nodiscard]] inline std::variant<std::monostate, error> evaluate(const compiled_expression& ce,
+		std::span<const std::span<const num_t>> columns, std::span<uint8_t> out, const isa kernels = detect()) {
+		if (ce.result_type() != value_type::boolean) return error::wrong_type;
+		return detail::run(ce, columns, out.size(), std::min(kernels, detect()),
+			[out](const size_t row, const size_t count, const num_t*, const mask_t* mask) {
+				for (size_t r = 0; r < count; ++r) out[row + r] = static_cast<uint8_t>(mask[r] & 1);
+			});
+	}
+
+	// boolean result of rows as bitmask: bit r % 64 of out[r / 64] is row r, bits past last row are 0.
+	// out holds at least (rows + 63) / 64 words
+	[[nodiscard]] inline std::variant<std::monostate, error> evaluate_mask(const compiled_expression& ce,
+		std::span<const std::span<const num_t>> columns, const size_t rows, std::span<uint64_t> out, const isa kernels = detect()) {
+		if (ce.result_type() != value_type::boolean) return error::wrong_type;
+		if (out.size() < (rows + 63) / 64) return error::out_of_range;
+		// blocks start at multiple of 64 rows
+		static_assert(block % 64 == 0);
+		return detail::run(ce, columns, rows, std::min(kernels, detect()),
+			[out](const size_t row, const size_t count, const num_t*, const mask_t* mask) {
+				for (size_t w = 0; w * 64 < count; ++w) {
+					uint64_t bits = 0;
+					for (size_t r = w * 64, end = std::min(count, r + 64); r < end; ++r)
+						bits |= (mask[r] & 1) << (r - w * 64);
+					out[row / 64 + w] = bits;
+				}
+			});
+	}
+}
@@ -0,0 +1,849 @@
+#include "benchmark.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <thread>
+#include <optional>
+#include <string_view>
+#include <cstdlib>
+
+#include "tokenizer.h"
+#include "shunting_yard.h"
+#include "compiled_expression.h"
+#include "equation_system.h"
+#include "thread_pool.h"
+#include "dependency_graph.h"
+#include "static_expression.h"
+#include "number_parser.h"
+#include "arena.h"
+#include "expression_cache.h"
+#include "memo.h"
+#include "batch.h"
+
+using namespace defs;
+
+namespace bench
+{
+	namespace {
+		volatile num_t sink = 0; // keeps results observable so calls are not optimized away
+
+		// average time of one call of f in nanoseconds
+		template<typename F>
+		double ns_per_call(F&& f, const size_t iterations) {
+			for (size_t i = 0; i < iterations / 10 + 1; ++i) f(); // warm up
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < iterations; ++i) f();
+			const auto stop = std::chrono::steady_clock::now();
+			return std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(iterations);
+		}
+
+		void consume(const std::variant<num_t, bool_t, error>& v) {
+			if (v.index() == 0) sink = sink + std::get<num_t>(v);
+			else if (v.index() == 1) sink = sink + (std::get<bool_t>(v) ? 1 : 0);
+		}
+
+		const std::map<std::string, num_t> vars { { "a", 2.0 }, { "b", 3.0 }, { "c", 4.0 } };
+
+		// samples from main.cpp and typical shapes of production formulas
+		const std::vector<std::string> samples {
+			"2+3*4^2",
+			"log(+82.3)+7^sin(+3.9^2)",
+			"2^If(5 == 8 | 6 > 5, 3, 4)",
+			"sin(60-min(3,4))",
+			"a*b+c",
+			"a*2+b/4-c*0.5",
+			"if(a < b, sin(a), cos(b))",
+			"78*sin(+c)+a*b+c^2",
+		};
+
+		std::vector<std::string> var_names() {
+			std::vector<std::string> names;
+			for (const auto& [name, _] : vars) names.push_back(name);
+			return names;
+		}
+
+		// wide system: levels of independent equations, each reads two equations of previous level
+		constexpr size_t wide_inputs = 16, wide_width = 256, wide_depth = 8;
+
+		std::string wide_name(const size_t level, const size_t j) { return "e" + std::to_string(level) + "_" + std::to_string(j); }
+
+		std::variant<solver::equation_system, error> wide_system(std::vector<num_t>& input_values) {
+			std::vector<std::string> inputs;
+			input_values.clear();
+			for (size_t i = 0; i < wide_inputs; ++i) {
+				inputs.push_back("x" + std::to_string(i));
+				input_values.push_back(0.1 * static_cast<num_t>(i + 1));
+			}
+			std::map<std::string, std::string> equations;
+			for (size_t j = 0; j < wide_width; ++j) {
+				const std::string x = inputs[j % wide_inputs], y = inputs[(j + 1) % wide_inputs], k = std::to_string(j + 1);
+				equations[wide_name(0, j)] = "sin(" + x + "*" + k + ")*cos(" + y + ")+(" + x + "^2+" + k + ")^0.5";
+			}
+			for (size_t level = 1; level < wide_depth; ++level) {
+				for (size_t j = 0; j < wide_width; ++j) {
+					const std::string p = wide_name(level - 1, j), q = wide_name(level - 1, (j + 1) % wide_width), k = std::to_string(level * wide_width + j + 1);
+					equations[wide_name(level, j)] = "sin(" + p + ")*exp(-abs(" + q + "))+log(" + p + "^2+" + k + ")";
+				}
+			}
+			return solver::equation_system::compile(solver::tokenizer{ inputs, equations });
+		}
+
+		// tokenizer::read_number<num_t> before std::from_chars, one multiply-add per digit
+		std::optional<num_t> legacy_number(const std::string_view s, size_t& idx) {
+			num_t d{ 0 };
+			do {
+				d = num_t{ 10 } * d + (s[idx++] - 0x30);
+			} while (idx < s.size() && std::isdigit(s[idx]));
+			if (idx >= s.size() || s[idx] != '.') return d;
+			++idx;
+			if (idx >= s.size() || !std::isdigit(s[idx])) return std::nullopt;
+			num_t f{ 0 }, mul{ 1 };
+			do {
+				mul /= num_t{ 10 };
+				f = f + mul * (s[idx++] - 0x30);
+			} while (idx < s.size() && std::isdigit(s[idx]));
+			return d + f;
+		}
+
+		// numeric-heavy formulas of 8 literals each, of one shape per corpus
+		std::vector<std::string> number_corpus(const size_t shape) {
+			std::vector<std::string> corpus;
+			uint64_t seed = 12345;
+			const auto next = [&seed] { seed = seed * 6364136223846793005ull + 1442695040888963407ull; return seed >> 33; };
+			for (size_t i = 0; i < 1000; ++i) {
+				std::string eq;
+				for (size_t k = 0; k < 8; ++k) {
+					if (k) eq += "+x*";
+					switch (shape) {
+						case 0: eq += std::to_string(next() % 100000); break;
+						case 1: eq += std::to_string(next() % 1000) + "." + std::to_string(next() % 100); break;
+						case 2: eq += "0.000" + std::to_string(next() % 10000); break;
+						case 3: eq += "0." + std::to_string(100'000'000'000'000 + next() * 1000 % 900'000'000'000'000); break;
+						default: eq += std::to_string(next() % 10) + "." + std::to_string(next()) + std::to_string(next()); break;
+					}
+				}
+				corpus.push_back(eq);
+			}
+			return corpus;
+		}
+
+		// one row of constexpr benchmark: same formula compiled at build time and on vm
+		template<solver::fixed_string S>
+		void static_row() {
+			constexpr auto f = solver::compile<S>();
+			const solver::tokenizer parser{ var_names(), {} };
+			std::vector<lex_wrapper> vec_lex = parser.parseSingle(std::string(S.view()));
+			vec_lex.pop_back(); // end
+
+			std::vector<std::string> names(f.variables().begin(), f.variables().end());
+			const auto ce = std::get<0>(solver::compiled_expression::compile(solver::shunting_yard::run(vec_lex), names));
+			volatile num_t in[f.n_vars + 1]; // volatile so constant inputs are not folded into inlined formula
+			for (size_t i = 0; i < f.n_vars; ++i) in[i] = vars.at(names[i]);
+
+			num_t values[f.n_vars + 1];
+			const auto load = [&] { for (size_t i = 0; i < f.n_vars; ++i) values[i] = in[i]; };
+			const double t_vm = ns_per_call([&] { load(); consume(ce.evaluate(std::span<const num_t>{ values, f.n_vars })); }, 5'000'000);
+			const double t_static = ns_per_call([&] { load(); sink = sink + static_cast<num_t>(f(values)); }, 5'000'000);
+			printf("%-32s %14.1f %14.1f %8.1fx\n", S.data, t_vm, t_static, t_vm / t_static);
+		}
+
+		// reproducible pseudo random numbers of verify(), same generator as number_corpus
+		struct lcg {
+			uint64_t seed;
+			size_t operator()(const size_t n) {
+				seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+				return (seed >> 33) % n;
+			}
+		};
+
+		std::string random_num(lcg& rnd, int depth);
+
+		// random boolean formula over a, b, c: comparisons joined by & and |
+		std::string random_bool(lcg& rnd, const int depth) {
+			const char* compare[] = { "<", "<=", ">", ">=", "==" };
+			if (depth <= 0 || rnd(3))
+				return "(" + random_num(rnd, depth - 1) + compare[rnd(5)] + random_num(rnd, depth - 1) + ")";
+			return "(" + random_bool(rnd, depth - 1) + (rnd(2) ? "&" : "|") + random_bool(rnd, depth - 1) + ")";
+		}
+
+		// random numeric formula over a, b, c with operators, functions of 1 to 4 arguments, if() and fma shapes
+		std::string random_num(lcg& rnd, const int depth) {
+			const char* numbers[] = { "0", "1", "2", "3", "0.5", "4", "1.5", "10", "7.25" };
+			if (depth <= 0) {
+				const size_t r = rnd(4);
+				if (r == 0) return numbers[rnd(9)];
+				if (r == 1) return "pi";
+				const char* names[] = { "a", "b", "c" };
+				return names[rnd(3)];
+			}
+			switch (rnd(9)) {
+				case 0: case 1: case 2: {
+					const char* ops[] = { "+", "-", "*", "/", "^", "+", "*" };
+					return "(" + random_num(rnd, depth - 1) + ops[rnd(7)] + random_num(rnd, depth - 1) + ")";
+				}
+				case 3: {
+					// shallow argument, sin and cos of huge values would turn last bit differences into any difference
+					const char* functions[] = { "sin", "cos", "abs", "floor", "exp", "sign", "round", "atan", "ceil" };
+					return std::string(functions[rnd(9)]) + "(" + random_num(rnd, std::min(depth - 1, 1)) + ")";
+				}
+				case 4: {
+					std::string s = rnd(2) ? "min(" : "max(";
+					for (size_t i = 0, n = 1 + rnd(4); i < n; ++i) s += (i ? "," : "") + random_num(rnd, depth - 1);
+					return s + ")";
+				}
+				case 5: return "if(" + random_bool(rnd, depth - 1) + "," + random_num(rnd, depth - 1) + "," + random_num(rnd, depth - 1) + ")";
+				case 6: return "(-" + random_num(rnd, depth - 1) + ")";
+				case 7: return "(" + random_num(rnd, depth - 1) + "*" + random_num(rnd, depth - 1) + "+" + random_num(rnd, depth - 1) + ")";
+				default: {
+					const char* exponents[] = { "0", "1", "2", "3", "0.5", "4", "1.5", "10", "7.25", "(-1)", "(-2)", "(-3)" };
+					return "(" + random_num(rnd, depth - 1) + "^" + exponents[rnd(12)] + ")";
+				}
+			}
+		}
+
+		// results of two evaluators agree: same type, numbers within relative tolerance (bit for bit when 0), any NaN equals any NaN.
+		// errors are not compared, evaluators report them at different stages
+		bool agree(const std::variant<num_t, bool_t, error>& x, const std::variant<num_t, bool_t, error>& y, const num_t tolerance = 0) {
+			if (x.index() != y.index()) return false;
+			if (x.index() == 1) return std::get<bool_t>(x) == std::get<bool_t>(y);
+			if (x.index() == 2) return true;
+			const num_t p = std::get<num_t>(x), q = std::get<num_t>(y);
+			if (std::isnan(p) || std::isnan(q)) return std::isnan(p) && std::isnan(q);
+			if (std::memcmp(&p, &q, sizeof(num_t)) == 0) return true;
+			if (std::isinf(p) || std::isinf(q)) return false;
+			return tolerance > 0 && std::abs(p - q) <= tolerance * std::max(std::abs(p), std::abs(q)) + 1e-12;
+		}
+
+		// one differential check of verify(), prints its first mismatches
+		struct check {
+			const char* name;
+			size_t tested{ 0 }, failed{ 0 };
+
+			void fail(const std::string& what) {
+				if (failed++ < 5) printf("  %s: %s\n", name, what.c_str());
+			}
+		};
+
+		// random formulas on shunting_yard::solve against vm, and vm against jit, branchless program and batch kernels
+		void verify_expressions(check& solve, check& jit, check& branchless, check& batch) {
+			const std::vector<std::string> names{ "a", "b", "c" };
+			const solver::tokenizer parser{ names, {} };
+			const num_t inputs[] = { -3, -1, -0.0, 0, 0.5, 1, 2, 2.75, NAN, INFINITY };
+			lcg rnd{ 42 };
+			for (size_t i = 0; i < 30'000; ++i) {
+				const std::string eq = rnd(5) == 0 ? random_bool(rnd, 1 + static_cast<int>(rnd(3))) : random_num(rnd, 1 + static_cast<int>(rnd(5)));
+				std::vector<lex_wrapper> infix = parser.parseSingle(eq);
+				if (infix.back().lex_type == lex::error) {
+					solve.fail(eq + " not parsed");
+					continue;
+				}
+				infix.pop_back(); // end
+
+				// finite inputs of moderate size or -0, shunting_yard differs from vm in rounding of fma and multiply chains only
+				const auto or_minus_zero = [&rnd](const num_t v) { return rnd(8) == 0 ? num_t{ -0.0 } : v; };
+				const std::vector<num_t> slots{ or_minus_zero(static_cast<num_t>(rnd(7)) - 3 + num_t{ 0.25 } * static_cast<num_t>(rnd(4))),
+					or_minus_zero(static_cast<num_t>(rnd(5)) - 2), or_minus_zero(num_t{ 0.5 } * static_cast<num_t>(rnd(5))) };
+				const std::map<std::string, num_t> values{ { "a", slots[0] }, { "b", slots[1] }, { "c", slots[2] } };
+				solver::shunting_yard sy{ infix, values };
+				const auto expected = sy.solve();
+				const std::vector<lex_wrapper> postfix = solver::shunting_yard::run(infix);
+				const auto compiled = solver::compiled_expression::compile(postfix, names);
+				if (compiled.index() == 1) {
+					if (expected.index() != 2) solve.fail(eq + " not compiled");
+					continue;
+				}
+				const auto& lazy = std::get<0>(compiled);
+				const auto result = lazy.evaluate(slots);
+				++solve.tested;
+				if (!agree(expected, result, 1e-9)) solve.fail(eq);
+
+				const auto native = solver::compiled_expression::compile(postfix, names, { .jit = true });
+				++jit.tested;
+				if (!agree(result, std::get<0>(native).evaluate(slots))) jit.fail(eq);
+
+				const auto flat = std::get<0>(solver::compiled_expression::compile(postfix, names, { .branchless = true }));
+				++branchless.tested;
+				if (!agree(result, flat.evaluate(slots))) branchless.fail(eq);
+
+				// every tenth formula over columns with NaN and infinity and partial last block,
+				// branchless program on every kernel set and program with jumps falling back to vm
+				if (i % 10) continue;
+				const size_t rows = 1 + rnd(600);
+				std::vector<std::vector<num_t>> columns(3, std::vector<num_t>(rows));
+				for (auto& column : columns)
+					for (auto& v : column) v = rnd(3) ? inputs[rnd(std::size(inputs))] : (static_cast<num_t>(rnd(2000)) - 1000) / 64;
+				const std::vector<std::span<const num_t>> spans(columns.begin(), columns.end());
+				const bool is_num = lazy.result_type() == value_type::num;
+				const std::pair<const solver::compiled_expression*, solver::batch::isa> runs[] = {
+					{ &flat, solver::batch::isa::scalar }, { &flat, solver::batch::isa::avx2 }, { &flat, solver::batch::isa::avx512 }, { &lazy, solver::batch::detect() } };
+				for (const auto& [ce, kernels] : runs) {
+					if (kernels > solver::batch::detect()) continue;
+					std::vector<num_t> out(rows);
+					std::vector<uint8_t> flags(rows);
+					const auto res = is_num ? solver::batch::evaluate(*ce, spans, std::span<num_t>{ out }, kernels) : solver::batch::evaluate(*ce, spans, std::span<uint8_t>{ flags }, kernels);
+					++batch.tested;
+					if (res.index() == 1) {
+						batch.fail(eq + " not evaluated");
+						continue;
+					}
+					for (size_t r = 0; r < rows; ++r) {
+						const std::vector<num_t> row{ columns[0][r], columns[1][r], columns[2][r] };
+						const std::variant<num_t, bool_t, error> got = is_num ? std::variant<num_t, bool_t, error>{ out[r] } : std::variant<num_t, bool_t, error>{ flags[r] != 0 };
+						if (!agree(lazy.evaluate(row), got)) {
+							batch.fail(eq + " row " + std::to_string(r));
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		// parse_postfix against parseSingle followed by shunting_yard::run on random formulas and random token soup, errors included
+		void verify_postfix(check& postfix) {
+			const solver::tokenizer parser{ { "a", "b", "Cc" }, {} };
+			const char* parts[] = { "a", "b", "cc", "2", "3.5", "1.", "pi", "PI", "+", "-", "*", "/", "^", "<", "<=", ">", ">=", "==", "|", "&",
+				"(", ")", ",", " ", "sin(", "min(", "Max(", "if(", "atan2(", "int(", "$", "x", "=", "log(", "1e3", "2E-2", "1e400", "1e-400" };
+			lcg rnd{ 7 };
+			for (size_t i = 0; i < 300'000; ++i) {
+				std::string eq;
+				if (i % 2) eq = rnd(5) == 0 ? random_bool(rnd, 1 + static_cast<int>(rnd(3))) : random_num(rnd, 1 + static_cast<int>(rnd(4)));
+				else
+					for (size_t k = 0, n = rnd(12); k < n; ++k) eq += parts[rnd(std::size(parts))];
+
+				std::vector<lex_wrapper> infix = parser.parseSingle(eq);
+				std::variant<std::vector<lex_wrapper>, error> expected;
+				if (infix.back().lex_type == lex::error) expected = infix.back().err();
+				else {
+					infix.pop_back(); // end
+					expected = solver::shunting_yard::run(infix);
+				}
+				const auto got = parser.parse_postfix(eq);
+				++postfix.tested;
+				bool same = expected.index() == got.index();
+				if (same && expected.index() == 1) same = std::get<error>(expected) == std::get<error>(got);
+				if (same && expected.index() == 0) {
+					const auto& a = std::get<0>(expected);
+					const auto& b = std::get<0>(got);
+					same = std::ranges::equal(a, b, [](const lex_wrapper& x, const lex_wrapper& y) { return x == y && x.n_args == y.n_args; });
+				}
+				if (!same) postfix.fail("'" + eq + "'");
+			}
+		}
+
+		// parse_number and big_decimal, the parser of constant evaluation, against correctly rounded strtod.
+		// literals of up to 800 digits, exponents beyond both ends of double range and printed exact doubles near halfway
+		void verify_numbers(check& runtime, check& constant) {
+			const auto compare = [&](const std::string& s) {
+				const num_t expected = std::strtod(s.c_str(), nullptr);
+				const auto matches = [&](const std::optional<num_t>& d) { return d && std::memcmp(&*d, &expected, sizeof(num_t)) == 0; };
+
+				size_t idx = 0;
+				const std::optional<num_t> parsed = parse_number(s, idx);
+				++runtime.tested;
+				if (!matches(parsed) || idx != s.size()) runtime.fail(s);
+
+				const size_t e = std::min(s.find('e'), s.size());
+				const int64_t exponent = e < s.size() ? std::atoll(s.c_str() + e + 1) : 0;
+				++constant.tested;
+				if (!matches(detail::big_decimal(s.data(), s.data() + e, exponent).to_double())) constant.fail(s);
+			};
+
+			// out of range literals round to inf or 0, last ones are halfway to smallest subnormal and past largest double
+			for (const std::string& s : std::vector<std::string>{ "1e400", "1e-400", std::string(400, '9'), "0." + std::string(400, '0') + "1",
+				"2.4703282292062327e-324", "2.4703282292062328e-324", "1.7976931348623157e308", "1.7976931348623159e308" })
+				compare(s);
+
+			lcg rnd{ 2024 };
+			for (size_t i = 0; i < 2'000'000; ++i) {
+				std::string s;
+				const size_t shape = rnd(6);
+				for (size_t k = 0, n = 1 + rnd(shape == 0 ? 800 : shape == 1 ? 40 : 25); k < n; ++k) s += static_cast<char>('0' + rnd(10));
+				if (rnd(2)) {
+					s.insert(1 + rnd(s.size()), ".");
+					if (s.back() == '.') s += '7';
+				}
+				if (shape >= 2 || rnd(2)) s += "e" + std::to_string(shape == 5 ? static_cast<int>(rnd(60)) - 30 : static_cast<int>(rnd(700)) - 350);
+				if (shape == 4) {
+					num_t d;
+					const uint64_t bits = (static_cast<uint64_t>(rnd(1u << 31)) << 32 | rnd(1ull << 32)) % 0x7FEFFFFFFFFFFFFFull;
+					std::memcpy(&d, &bits, sizeof(num_t));
+					char buf[64];
+					snprintf(buf, sizeof(buf), "%.40e", d);
+					s = buf;
+					if (rnd(2)) s[s.find('e') - 1] = rnd(2) ? '5' : '0';
+				}
+
+				compare(s);
+			}
+		}
+
+		// value of one equation of system of given equations over a, b, c
+		num_t system_value(const std::map<std::string, std::string>& equations, const std::string& name) {
+			auto sys = solver::equation_system::compile(solver::tokenizer{ var_names(), equations });
+			if (sys.index() == 1) return NAN;
+			auto& system = std::get<0>(sys);
+			const auto values = system.evaluate(std::vector<num_t>{ 0.1, 0.7, -0.07 });
+			if (values.index() == 1) return NAN;
+			const auto names = system.names();
+			return std::get<0>(values)[std::ranges::find(names, name) - names.begin()];
+		}
+
+		// equation of system evaluates bit for bit as when alone, whatever subexpressions other equations share with it
+		void verify_sharing(check& sharing) {
+			const char* equations[] = { "a*b+c", "c+a*b", "(a*b+0)+c", "(a*b)*1+c", "(a*b-0)+c", "(1*(a*b))+c", "(a*b/1)+c", "sin(a*b+c)+a*b" };
+			const char* others[] = { "a*b*2", "a*b", "a*b+0", "(a*b-0)*3", "a*b/1", "1*(a*b)", "sin(a*b)", "a*b-0" };
+			for (const char* x : equations) {
+				const num_t alone = system_value({ { "x", x } }, "x");
+				for (const char* y : others) {
+					const num_t shared = system_value({ { "x", x }, { "y", y } }, "x");
+					++sharing.tested;
+					if (std::memcmp(&alone, &shared, sizeof(num_t)) != 0) sharing.fail(std::string(x) + " next to " + y);
+				}
+			}
+		}
+	}
+
+	void evaluator() {
+		const solver::tokenizer parser{ var_names(), {} };
+		printf("%-32s %14s %14s %9s\n", "expression", "solve ns", "compiled ns", "speedup");
+		for (const auto& eq : samples) {
+			std::vector<lex_wrapper> vec_lex = parser.parseSingle(eq);
+			if (vec_lex.empty() || vec_lex.back().lex_type == lex::error) {
+				printf("%-32s cannot parse\n", eq.c_str());
+				continue;
+			}
+			vec_lex.pop_back(); // end
+
+			const solver::shunting_yard algo{ vec_lex, vars };
+			const auto compiled = algo.compile();
+			if (compiled.index() == 1) {
+				printf("%-32s cannot compile: %s\n", eq.c_str(), error_str[std::get<error>(compiled)].c_str());
+				continue;
+			}
+			const auto& ce = std::get<solver::compiled_expression>(compiled);
+			const std::vector<num_t> values = std::get<0>(ce.bind(vars));
+
+			const double t_solve = ns_per_call([&] { consume(algo.solve()); }, 200'000);
+			const double t_compiled = ns_per_call([&] { consume(ce.evaluate(values)); }, 5'000'000);
+			printf("%-32s %14.1f %14.1f %8.1fx\n", eq.c_str(), t_solve, t_compiled, t_solve / t_compiled);
+		}
+	}
+
+	void jit() {
+		if (!solver::jit::available()) printf("jit is not available on this platform, both columns run on vm\n");
+		const solver::tokenizer parser{ var_names(), {} };
+		printf("%-32s %14s %14s %9s\n", "expression", "vm ns", "jit ns", "speedup");
+		for (const auto& eq : samples) {
+			std::vector<lex_wrapper> vec_lex = parser.parseSingle(eq);
+			if (vec_lex.empty() || vec_lex.back().lex_type == lex::error) {
+				printf("%-32s cannot parse\n", eq.c_str());
+				continue;
+			}
+			vec_lex.pop_back(); // end
+
+			const auto postfix = solver::shunting_yard::run(vec_lex);
+			const auto vm = solver::compiled_expression::compile(postfix, var_names());
+			const auto native = solver::compiled_expression::compile(postfix, var_names(), { .jit = true });
+			if (vm.index() == 1 || native.index() == 1) {
+				printf("%-32s cannot compile\n", eq.c_str());
+				continue;
+			}
+			const auto& ce_vm = std::get<0>(vm);
+			const auto& ce_native = std::get<0>(native);
+			const std::vector<num_t> values = std::get<0>(ce_vm.bind(vars));
+
+			const double t_vm = ns_per_call([&] { consume(ce_vm.evaluate(values)); }, 5'000'000);
+			const double t_native = ns_per_call([&] { consume(ce_native.evaluate(values)); }, 5'000'000);
+			printf("%-32s %14.1f %14.1f %8.1fx\n", eq.c_str(), t_vm, t_native, t_vm / t_native);
+		}
+	}
+
+	void static_expression() {
+		printf("%-32s %14s %14s %9s\n", "expression", "vm ns", "constexpr ns", "speedup");
+		static_row<"a*b+c">();
+		static_row<"a*2+b/4-c*0.5">();
+		static_row<"if(a < b, sin(a), cos(b))">();
+		static_row<"78*sin(+c)+a*b+c^2">();
+		static_row<"max(a, b, c)*min(a, b)-c/a">();
+	}
+
+	void parallel() {
+		std::vector<num_t> input_values;
+		auto compiled = wide_system(input_values);
+		if (compiled.index() == 1) {
+			printf("cannot compile system: %s\n", error_str[std::get<error>(compiled)].c_str());
+			return;
+		}
+		auto& sys = std::get<0>(compiled);
+		const auto serial = std::get<0>(sys.evaluate(input_values));
+		const std::vector<num_t> expected(serial.begin(), serial.end());
+
+		const double t_serial = ns_per_call([&] { sink = sink + std::get<0>(sys.evaluate(input_values))[0]; }, 200);
+		printf("%zu equations, serial evaluation %.1f us\n", expected.size(), t_serial / 1000);
+		printf("%8s %14s %9s %14s\n", "threads", "us", "speedup", "deterministic");
+
+		const size_t max_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		for (size_t n = 1; n <= max_threads; n = n < max_threads && n * 2 > max_threads ? max_threads : n * 2) {
+			solver::work_stealing_pool pool{ n };
+			const double t = ns_per_call([&] { sink = sink + std::get<0>(sys.evaluate(input_values, pool))[0]; }, 200);
+			const auto values = std::get<0>(sys.evaluate(input_values, pool));
+			const bool same = std::memcmp(values.data(), expected.data(), expected.size() * sizeof(num_t)) == 0;
+			printf("%8zu %14.1f %8.2fx %14s\n", n, t / 1000, t_serial / t, same ? "yes" : "NO");
+		}
+	}
+
+	void graph() {
+		printf("%10s %12s %16s %14s\n", "equations", "edges", "pairwise ms", "csr ms");
+		for (const size_t n : { 1'000, 10'000, 100'000 }) {
+			// e_i = e_(i-1) + e_(i/2) * x, so every equation holds 5 tokens and 2 references
+			std::vector<std::string> names;
+			std::vector<std::vector<lex_wrapper>> eqs;
+			symbol_table symbols;
+			for (size_t i = 0; i < n; ++i)
+				names.push_back("e" + std::to_string(i));
+			for (size_t i = 0; i < n; ++i) {
+				std::vector<lex_wrapper>& eq = eqs.emplace_back();
+				eq.emplace_back(lex::variable, symbols.intern(i == 0 ? std::string("x") : names[i - 1]));
+				eq.emplace_back(lex::variable, symbols.intern(names[i / 2]));
+				eq.emplace_back(lex::variable, symbols.intern("x"));
+				eq.emplace_back(lex::multiply, builtin_symbols.find("*"));
+				eq.emplace_back(lex::plus, builtin_symbols.find("+"));
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			const solver::csr_graph g = solver::build_dependency_graph(names, eqs);
+			const double t_csr = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			// previous construction compared every pair of equations, too slow to wait for at 100k
+			char pairwise[32] = "-";
+			if (n <= 10'000) {
+				const auto start_pw = std::chrono::steady_clock::now();
+				std::vector<std::vector<size_t>> adj(n);
+				for (size_t i = 0; i < n; ++i) {
+					for (size_t j = 0; j < n; ++j) {
+						if (std::ranges::any_of(eqs[i], [&](const lex_wrapper& lw) { return lw.lex_type == lex::variable && lw.name() == names[j]; }))
+							adj[i].push_back(j);
+					}
+				}
+				const double t_pw = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_pw).count();
+				snprintf(pairwise, sizeof(pairwise), "%.1f", t_pw);
+			}
+			printf("%10zu %12zu %16s %14.1f\n", n, g.n_edges(), pairwise, t_csr);
+		}
+	}
+
+	void demand() {
+		std::vector<num_t> input_values;
+		auto compiled = wide_system(input_values);
+		if (compiled.index() == 1) {
+			printf("cannot compile system: %s\n", error_str[std::get<error>(compiled)].c_str());
+			return;
+		}
+		auto& sys = std::get<0>(compiled);
+		const double t_full = ns_per_call([&] { sink = sink + std::get<0>(sys.evaluate(input_values))[0]; }, 200);
+		printf("%-28s %10s %12s %9s\n", "requested outputs", "equations", "us", "speedup");
+		printf("%-28s %10zu %12.1f %9s\n", "all", sys.names().size(), t_full / 1000, "1.00x");
+
+		// 5 outputs from top of the system, their cones widen by one equation per level
+		std::vector<std::string> top, mid;
+		for (size_t j = 0; j < 5; ++j) {
+			top.push_back(wide_name(wide_depth - 1, j * 50));
+			mid.push_back(wide_name(wide_depth / 2, j * 50));
+		}
+		for (const auto& [label, outputs] : { std::pair{ "5 at top level", top }, std::pair{ "5 at middle level", mid } }) {
+			const size_t id = std::get<0>(sys.select(outputs));
+			const double t = ns_per_call([&] { sink = sink + std::get<0>(sys.evaluate(id, input_values))[0]; }, 20'000);
+			printf("%-28s %10zu %12.2f %8.1fx\n", label, sys.selection_size(id), t / 1000, t_full / t);
+		}
+	}
+
+	void tokenize() {
+		printf("%10s %12s\n", "variables", "ns per call");
+		for (const size_t n : { 10, 1'000, 10'000, 100'000 }) {
+			std::vector<std::string> names;
+			for (size_t i = 0; i < n; ++i)
+				names.push_back("v" + std::to_string(i));
+			const solver::tokenizer tk{ names, {} };
+
+			// names from the end of dictionary in other case, worst case of former linear lookup
+			const std::string eq = "V" + std::to_string(n - 1) + "*2+Sin(v" + std::to_string(n - 2) + ")-v" + std::to_string(n / 2) + "^2";
+			const double t = ns_per_call([&] { sink = sink + static_cast<num_t>(tk.parseSingle(eq).size()); }, 20'000);
+			printf("%10zu %12.1f\n", n, t);
+		}
+	}
+
+	void parser() {
+		const solver::tokenizer parser{ var_names(), {} };
+		printf("%-32s %14s %14s %9s\n", "expression", "passes ns", "one pass ns", "speedup");
+		for (const auto& eq : samples) {
+			const double t_passes = ns_per_call([&] {
+				std::vector<lex_wrapper> vec_lex = parser.parseSingle(eq);
+				vec_lex.pop_back();
+				sink = sink + static_cast<num_t>(solver::shunting_yard::run(vec_lex).size());
+			}, 50'000);
+			const double t_single = ns_per_call([&] { sink = sink + static_cast<num_t>(std::get<0>(parser.parse_postfix(eq)).size()); }, 50'000);
+			printf("%-32s %14.1f %14.1f %8.1fx\n", eq.c_str(), t_passes, t_single, t_passes / t_single);
+		}
+	}
+
+	void numbers() {
+		printf("%-24s %12s %14s %16s\n", "literals", "misrounded", "legacy ns", "parse_number ns");
+		const char* labels[] = { "integers", "prices", "rates 0.000x", "fractions of 15 digits", "constants of 20+ digits" };
+		for (size_t shape = 0; shape < std::size(labels); ++shape) {
+			const std::vector<std::string> corpus = number_corpus(shape);
+			const auto scan = [&](auto&& parse) {
+				for (const auto& eq : corpus) {
+					for (size_t idx = 0; idx < eq.size();) {
+						if (std::isdigit(eq[idx])) sink = sink + *parse(eq, idx);
+						else ++idx;
+					}
+				}
+			};
+
+			// legacy results against correctly rounded strtod
+			size_t n_numbers = 0, n_differ = 0;
+			scan([&](const std::string_view eq, size_t& idx) {
+				const num_t expected = std::strtod(eq.data() + idx, nullptr);
+				const std::optional<num_t> legacy = legacy_number(eq, idx);
+				n_differ += std::memcmp(&*legacy, &expected, sizeof(num_t)) != 0;
+				++n_numbers;
+				return legacy;
+			});
+
+			const double t_legacy = ns_per_call([&] { scan(legacy_number); }, 200) / static_cast<double>(n_numbers);
+			const double t_new = ns_per_call([&] { scan(parse_number); }, 200) / static_cast<double>(n_numbers);
+			printf("%-24s %7zu/%zu %14.1f %16.1f\n", labels[shape], n_differ, n_numbers, t_legacy, t_new);
+		}
+	}
+
+	void compile() {
+		// 40k equations of 20 tokens, each referencing 2 earlier ones
+		std::map<std::string, std::string> equations;
+		for (size_t i = 0; i < 40'000; ++i) {
+			const std::string prev = i == 0 ? "a" : "e" + std::to_string(i - 1);
+			const std::string half = i < 2 ? "b" : "e" + std::to_string(i / 2);
+			equations["e" + std::to_string(i)] = prev + "*a+sin(" + half + ")-b*2.5+" + std::to_string(i % 7) + "*max(a,c,1e-3)";
+		}
+		const solver::tokenizer parser{ var_names(), equations };
+
+		const auto ms = [](auto&& f) {
+			const auto start = std::chrono::steady_clock::now();
+			f();
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		};
+		std::variant<solver::equation_set, error> serial;
+		const double t_serial = ms([&] { serial = parser.parse(); });
+		printf("%zu equations, serial parse %.1f ms\n", equations.size(), t_serial);
+		printf("%8s %14s %9s %14s\n", "threads", "ms", "speedup", "deterministic");
+
+		const size_t max_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		for (size_t n = 1; n <= max_threads; n = n < max_threads && n * 2 > max_threads ? max_threads : n * 2) {
+			solver::work_stealing_pool pool{ n };
+			std::variant<solver::equation_set, error> set;
+			const double t = ms([&] { set = parser.parse(pool); });
+			const bool same = set.index() == 0 && serial.index() == 0 && std::get<0>(set).postfix == std::get<0>(serial).postfix;
+			printf("%8zu %14.1f %8.2fx %14s\n", n, t, t_serial / t, same ? "yes" : "NO");
+		}
+	}
+
+	void allocations() {
+		const solver::tokenizer parser{ var_names(), {} };
+		const std::vector<std::string> names = var_names();
+		solver::arena scratch;
+
+		// text to compiled_expression, scratch memory from mr
+		const auto compile = [&](const std::string& eq, std::pmr::memory_resource* mr) {
+			const auto postfix = parser.parse_postfix(eq, mr);
+			const auto ce = solver::compiled_expression::compile(std::get<0>(postfix), names, {}, mr);
+			sink = sink + static_cast<num_t>(std::get<0>(ce).program().size());
+		};
+		// "-" when allocations are not counted in this build
+		const auto allocations_per_call = [](auto&& f) {
+			constexpr size_t n = 1'000;
+			f(); // arena grows on first call
+			const std::optional<size_t> before = heap_allocations();
+			for (size_t i = 0; i < n; ++i) f();
+			char text[32] = "-";
+			if (before) snprintf(text, sizeof(text), "%.1f", static_cast<double>(*heap_allocations() - *before) / n);
+			return std::string{ text };
+		};
+
+		if (!heap_allocations()) printf("heap allocations are counted only in builds with BENCH_COUNT_ALLOCATIONS defined\n");
+		printf("%-32s %12s %12s %12s %12s\n", "expression", "heap allocs", "arena allocs", "heap ns", "arena ns");
+		for (const auto& eq : samples) {
+			const auto on_heap = [&] { compile(eq, std::pmr::get_default_resource()); };
+			const auto on_arena = [&] { scratch.reset(); compile(eq, scratch.resource()); };
+			printf("%-32s %12s %12s %12.1f %12.1f\n", eq.c_str(), allocations_per_call(on_heap).c_str(), allocations_per_call(on_arena).c_str(),
+				ns_per_call(on_heap, 50'000), ns_per_call(on_arena, 50'000));
+		}
+		printf("arena block %zu bytes, overflowed %zu times\n", scratch.capacity(), scratch.overflows());
+	}
+
+	void cache() {
+		// samples as front end sends them, same formula in several spellings
+		std::vector<std::string> requests;
+		for (const auto& eq : samples) {
+			std::string upper = eq, spaced;
+			std::ranges::transform(upper, upper.begin(), [](const char c) { return static_cast<char>(std::toupper(c)); });
+			for (const char c : eq) {
+				if (c == '(' || c == ')' || c == ',') spaced += ' ';
+				spaced += c;
+			}
+			requests.insert(requests.end(), { eq, upper, spaced });
+		}
+		const solver::tokenizer parser{ var_names(), {} };
+		size_t i = 0;
+		const auto next = [&]() -> const std::string& { return requests[i++ % requests.size()]; };
+
+		const double t_compile = ns_per_call([&] {
+			const auto postfix = parser.parse_postfix(next());
+			if (postfix.index() == 0) sink = sink + static_cast<num_t>(solver::compiled_expression::compile(std::get<0>(postfix)).index());
+		}, 100'000);
+		printf("%-24s %10s %10s %10s\n", "", "ns", "hits", "misses");
+		printf("%-24s %10.1f\n", "compile every request", t_compile);
+		for (const size_t capacity : { 64, 4 }) {
+			solver::expression_cache cache{ parser, capacity };
+			const double t = ns_per_call([&] { sink = sink + static_cast<num_t>(cache.get(next()).index()); }, 100'000);
+			const std::string label = "cache of " + std::to_string(capacity);
+			printf("%-24s %10.1f %10zu %10zu\n", label.c_str(), t, cache.hits(), cache.misses());
+		}
+	}
+
+	void memo() {
+		uint64_t seed = 777;
+		const auto next = [&seed] { seed = seed * 6364136223846793005ull + 1442695040888963407ull; return seed >> 33; };
+		constexpr size_t n_ticks = 4096;
+		// ticks drawn from given number of distinct quotes, drifting inputs get new value on every tick
+		const auto ticks = [&](const size_t width, const size_t distinct, const size_t drifting) {
+			std::vector<std::vector<num_t>> quotes(distinct, std::vector<num_t>(width));
+			for (auto& q : quotes)
+				for (auto& v : q) v = static_cast<num_t>(next() % 10000) / 100;
+			std::vector<std::vector<num_t>> stream;
+			for (size_t i = 0; i < n_ticks; ++i) {
+				stream.push_back(quotes[next() % distinct]);
+				for (size_t k = 0; k < drifting; ++k) stream.back()[k] = static_cast<num_t>(i) / 64;
+			}
+			return stream;
+		};
+
+		const solver::tokenizer parser{ var_names(), {} };
+		const auto ce = std::make_shared<const solver::compiled_expression>(std::get<0>(
+			solver::compiled_expression::compile(std::get<0>(parser.parse_postfix("exp(a)*sin(b)+log(c+1)^2*cos(a*b)")), var_names())));
+		printf("%-32s %10s %10s %9s\n", "expression ticks", "plain ns", "memo ns", "hit rate");
+		for (const auto& [label, distinct, drifting] : { std::tuple{ "64 distinct", 64, 0 }, std::tuple{ "all distinct", 1, 1 } }) {
+			const auto stream = ticks(3, distinct, drifting);
+			size_t i = 0;
+			const double t_plain = ns_per_call([&] { consume(ce->evaluate(stream[i++ % n_ticks])); }, 400'000);
+			solver::memoized_expression memoized{ ce, 256 };
+			const double t_memo = ns_per_call([&] { consume(memoized.evaluate(stream[i++ % n_ticks])); }, 400'000);
+			printf("%-32s %10.1f %10.1f %8.0f%%\n", label, t_plain, t_memo, memoized.stats().hit_rate() * 100);
+		}
+
+		std::vector<num_t> input_values;
+		auto plain = std::get<0>(wide_system(input_values));
+		auto whole = std::get<0>(wide_system(input_values));
+		auto equations = std::get<0>(wide_system(input_values));
+		whole.memoize({});
+		equations.memoize({ .equations = true });
+		printf("%-32s %10s %10s %9s %10s %9s\n", "system ticks", "plain us", "system us", "hit rate", "+eqs us", "eq hits");
+		for (const auto& [label, distinct, drifting] : { std::tuple{ "64 distinct", 64, 0 }, std::tuple{ "8 distinct, x0 drifting", 8, 1 } }) {
+			const auto stream = ticks(wide_inputs, distinct, drifting);
+			size_t i = 0;
+			const auto run = [&](solver::equation_system& sys) {
+				return ns_per_call([&] { sink = sink + std::get<0>(sys.evaluate(stream[i++ % n_ticks]))[0]; }, 20'000) / 1000;
+			};
+			const solver::memo_stats before = whole.memo_statistics(), eq_before = equations.equation_memo_statistics();
+			const double t_plain = run(plain), t_whole = run(whole), t_equations = run(equations);
+			const solver::memo_stats after = whole.memo_statistics(), eq_after = equations.equation_memo_statistics();
+			const auto rate = [](const solver::memo_stats& a, const solver::memo_stats& b) { return 100.0 * static_cast<double>(b.hits - a.hits) / static_cast<double>(b.hits + b.misses - a.hits - a.misses); };
+			printf("%-32s %10.2f %10.2f %8.0f%% %10.2f %8.0f%%\n", label, t_plain, t_whole, rate(before, after), t_equations, rate(eq_before, eq_after));
+		}
+	}
+
+	void batch() {
+		constexpr size_t rows = 1'000'000;
+		uint64_t seed = 4242;
+		const auto next = [&seed] { seed = seed * 6364136223846793005ull + 1442695040888963407ull; return static_cast<num_t>(seed >> 33) / 2147483648.0 * 20 - 10; };
+		// same values as columns for batch and as rows for evaluate()
+		std::vector<std::vector<num_t>> columns(3, std::vector<num_t>(rows));
+		std::vector<num_t> row_major(rows * 3);
+		for (size_t r = 0; r < rows; ++r) {
+			for (size_t k = 0; k < 3; ++k) columns[k][r] = row_major[r * 3 + k] = next();
+		}
+		const std::vector<std::span<const num_t>> inputs(columns.begin(), columns.end());
+		std::vector<num_t> out(rows);
+		std::vector<uint8_t> flags(rows);
+
+		constexpr const char* isa_names[] = { "scalar", "avx2", "avx512" };
+		printf("detected kernels: %s\n", isa_names[static_cast<size_t>(solver::batch::detect())]);
+		printf("%-32s %8s %8s %8s %8s\n", "ns per row", "vm", "scalar", "avx2", "avx512");
+		const solver::tokenizer parser{ var_names(), {} };
+		for (const char* formula : { "a*b+c", "a*2+b/4-c*0.5", "if(a < b, a*2, b-c)", "78*sin(+c)+a*b+c^2", "(a*a+b*b)^0.5 < c & a > 0" }) {
+			const auto ce = std::get<0>(solver::compiled_expression::compile(std::get<0>(parser.parse_postfix(formula)), var_names(), { .branchless = true }));
+			const bool is_num = ce.result_type() == value_type::num;
+			solver::vm::registers regs;
+			const double t_vm = ns_per_call([&] {
+				for (size_t r = 0; r < rows; ++r) {
+					const auto res = ce.evaluate(std::span<const num_t>{ &row_major[r * 3], 3 }, regs);
+					if (is_num) out[r] = std::get<num_t>(res);
+					else flags[r] = std::get<bool_t>(res);
+				}
+				sink = sink + out[rows / 2] + flags[rows / 2];
+			}, 5) / rows;
+			printf("%-32s %8.2f", formula, t_vm);
+			for (const auto kernels : { solver::batch::isa::scalar, solver::batch::isa::avx2, solver::batch::isa::avx512 }) {
+				if (kernels > solver::batch::detect()) {
+					printf(" %8s", "-");
+					continue;
+				}
+				const double t = ns_per_call([&] {
+					const auto res = is_num ? solver::batch::evaluate(ce, inputs, std::span<num_t>{ out }, kernels) : solver::batch::evaluate(ce, inputs, std::span<uint8_t>{ flags }, kernels);
+					sink = sink + static_cast<num_t>(res.index()) + out[rows / 2] + flags[rows / 2];
+				}, 20) / rows;
+				printf(" %8.2f", t);
+			}
+			printf("\n");
+		}
+	}
+
+	int verify() {
+		check solve{ "shunting_yard::solve / vm" }, jit{ "vm / jit" }, branchless{ "vm / branchless" }, batch{ "vm / batch kernels" };
+		check postfix{ "parseSingle+run / parse_postfix" }, runtime{ "strtod / parse_number" }, constant{ "strtod / big_decimal" };
+		check sharing{ "alone / in system" };
+		verify_expressions(solve, jit, branchless, batch);
+		verify_postfix(postfix);
+		verify_numbers(runtime, constant);
+		verify_sharing(sharing);
+
+		printf("%-32s %10s %10s\n", "check", "tested", "failed");
+		size_t failed = 0;
+		for (const check* c : { &solve, &jit, &branchless, &batch, &postfix, &runtime, &constant, &sharing }) {
+			printf("%-32s %10zu %10zu\n", c->name, c->tested, c->failed);
+			failed += c->failed;
+		}
+		return failed == 0 ? 0 : 1;
+	}
+
+	int run(const std::string& name) {
+		if (name == "verify") return verify();
+		if (name.empty() || name == "evaluator") evaluator();
+		if (name.empty() || name == "jit") jit();
+		if (name.empty() || name == "static") static_expression();
+		if (name.empty() || name == "parallel") parallel();
+		if (name.empty() || name == "graph") graph();
+		if (name.empty() || name == "demand") demand();
+		if (name.empty() || name == "tokenize") tokenize();
+		if (name.empty() || name == "parser") parser();
+		if (name.empty() || name == "numbers") numbers();
+		if (name.empty() || name == "compile") compile();
+		if (name.empty() || name == "alloc") allocations();
+		if (name.empty() || name == "cache") cache();
+		if (name.empty() || name == "memo") memo();
+		if (name.empty() || name == "batch") batch();
+		return 0;
+	}
+}
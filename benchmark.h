@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <optional>
+
+namespace bench
+{
+	// calls of global operator new in whole process so far, counted by replacements in heap_counter.cpp.
+	// nullopt unless built with BENCH_COUNT_ALLOCATIONS, other builds keep standard allocator
+	std::optional<size_t> heap_allocations();
+
+	// runs benchmark by name, or all of them for empty name. returns process exit code
+	int run(const std::string& name);
+
+	// differential checks, not run with benchmarks: random formulas on every evaluator, parse_postfix against two pass parser,
+	// 2M literals against strtod and shared subexpressions of systems. prints first mismatches, returns 1 when any check failed
+	int verify();
+
+	// ns per evaluation of shunting_yard::solve against compiled_expression::evaluate
+	void evaluator();
+
+	// ns per evaluation of compiled_expression on vm against native code from jit
+	void jit();
+
+	// ns per evaluation of compiled_expression on vm against expression compiled at build time by solver::compile<>
+	void static_expression();
+
+	// wide equation system evaluated serially and on work_stealing_pool with 1 to hardware_concurrency threads
+	void parallel();
+
+	// dependency graph construction of synthetic systems with 1k, 10k and 100k equations
+	void graph();
+
+	// 5 outputs of wide equation system evaluated through their cone against whole system
+	void demand();
+
+	// tokenizer::parseSingle of one expression against dictionaries of 10 to 100k variables
+	void tokenize();
+
+	// ns per expression of parseSingle followed by shunting_yard::run against tokenizer::parse_postfix
+	void parser();
+
+	// ns per number literal of legacy digit by digit parser against parse_number over numeric-heavy corpora
+	void numbers();
+
+	// tokenizer::parse of 40k equation system serially and on work_stealing_pool with 1 to hardware_concurrency threads
+	void compile();
+
+	// global heap allocations and ns per compilation of expression text with default resource against arena reset per request
+	void allocations();
+
+	// ns per request of compiling every formula against expression_cache of 64 and of 4 entries, 8 formulas in 3 spellings each
+	void cache();
+
+	// ns per evaluation over replayed ticks of compiled_expression and wide equation system, plain against memoized
+	void memo();
+
+	// ns per row of formula over 1M rows of columns, evaluate() row by row against batch::evaluate with every supported kernel set
+	void batch();
+}
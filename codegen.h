@@ -0,0 +1,514 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <variant>
+#include <unordered_map>
+#include <string_view>
+#include <span>
+#include <memory_resource>
+#include <cmath>
+
+#include "maps.h"
+#include "type_check.h"
+#include "vm.h"
+
+namespace solver
+{
+	struct compile_options {
+		bool fold_constants{ true };       // evaluate variable free subtrees at compile time
+		bool reciprocal_division{ false }; // x/c becomes x*(1/c), changes rounding unless c is power of two
+		bool jit{ false };                 // translate register program to native code when platform supports it (see jit.h)
+		bool branchless{ false };          // if(), & and | evaluate all operands instead of jumping, so batch.h runs whole program per block
+	};
+
+	// variable names to their slots, names are viewed so building it for one compilation copies no strings
+	using slot_map = std::pmr::unordered_map<std::string_view, size_t>;
+
+	// lowers type checked postfix program to register program of vm.
+	// values of subexpressions stay as operands (variable slot, immediate, pending product or comparison)
+	// until consumer decides how to use them, which is where fused instructions come from.
+	// peephole rewrites are done on selection too: identities are dropped, integer powers become multiply chains,
+	// x^0.5 becomes sqrt, division by constant may become multiplication and min/max use branchless instructions.
+	// if(), & and | with expensive operands are lowered to conditional jumps so untaken operand is not evaluated,
+	// unless options ask for branchless program.
+	// all working memory comes from given resource, only resulting program is allocated on heap
+	class codegen
+	{
+		struct node {
+			size_t tok;        // index of token in postfix
+			value_type type;
+			size_t first_child; // index into _children
+			size_t n_children;
+			size_t cost;        // rough cost of evaluating whole subtree
+		};
+
+		// operands cheaper than this are evaluated eagerly, branch would cost more than computing them
+		static constexpr size_t lazy_cost = 8;
+		static constexpr size_t call_cost = 8;
+
+		struct operand {
+			enum class kind { reg, var, imm, product, compare } k;
+			value_type type{ value_type::num };
+			uint32_t x{ 0 }; // register or slot
+			uint32_t y{ 0 }; // second register of pending product or comparison
+			num_t imm{ 0 };
+			lex cmp{ lex::less }; // operator of pending comparison
+		};
+
+		std::span<const lex_wrapper> _postfix;
+		const slot_map& _slots;
+		const compile_options& _options;
+		std::pmr::memory_resource* _mr;
+		std::pmr::vector<node> _nodes;
+		std::pmr::vector<size_t> _children;
+
+		// node being generated, lazy forms emit jumps between its children
+		struct frame {
+			enum class kind { eager, lazy_if, short_circuit } k;
+			size_t n;          // node
+			size_t next{ 0 };  // child to generate next
+			size_t args{ 0 };  // its first operand in _operands
+			size_t jump{ 0 };  // jump waiting for patch
+			uint32_t dst{ 0 }; // register lazy form ends in
+		};
+
+		std::vector<vm::instruction> _program;
+		std::pmr::vector<frame> _frames;
+		std::pmr::vector<operand> _operands; // values of generated children not consumed yet
+		std::pmr::vector<uint32_t> _free_num, _free_bool;
+		uint32_t _n_num{ 0 }, _n_bool{ 0 };
+
+		uint32_t alloc(const value_type t) {
+			auto& free = t == value_type::num ? _free_num : _free_bool;
+			if (!free.empty()) {
+				const uint32_t r = free.back();
+				free.pop_back();
+				return r;
+			}
+			return t == value_type::num ? _n_num++ : _n_bool++;
+		}
+
+		void release(const operand& op) {
+			if (op.k == operand::kind::reg)
+				(op.type == value_type::num ? _free_num : _free_bool).push_back(op.x);
+			else if (op.k == operand::kind::product || op.k == operand::kind::compare) {
+				if (op.y != op.x) _free_num.push_back(op.y); // x*x
+				_free_num.push_back(op.x);
+			}
+		}
+
+		uint32_t emit(vm::instruction ins) {
+			_program.push_back(ins);
+			return ins.dst;
+		}
+
+		static vm::op_code jump_unless_code(const lex l) {
+			switch (l) {
+				case lex::less:       return vm::op_code::jump_nlt;
+				case lex::less_equal: return vm::op_code::jump_nle;
+				case lex::more:       return vm::op_code::jump_ngt;
+				case lex::more_equal: return vm::op_code::jump_nge;
+				default:              return vm::op_code::jump_neq;
+			}
+		}
+
+		// emits jump to be patched later, taken when condition is false
+		size_t emit_jump_unless(const operand& cond) {
+			const size_t at = _program.size();
+			if (cond.k == operand::kind::compare) {
+				release(cond);
+				_program.push_back({ .code = jump_unless_code(cond.cmp), .a = cond.x, .b = cond.y });
+			}
+			else {
+				const uint32_t a = materialize(cond);
+				_free_bool.push_back(a);
+				_program.push_back({ .code = vm::op_code::jump_unless, .a = a });
+			}
+			return at;
+		}
+
+		// target of jump is current end of program
+		void patch(const size_t jump) { _program[jump].c = static_cast<uint32_t>(_program.size()); }
+
+		// evaluates operand into given register
+		void materialize_into(const operand& op, const uint32_t dst) {
+			const uint32_t r = materialize(op);
+			if (r == dst) return;
+			(op.type == value_type::num ? _free_num : _free_bool).push_back(r);
+			emit({ .code = op.type == value_type::num ? vm::op_code::mov : vm::op_code::bmov, .dst = dst, .a = r });
+		}
+
+		static vm::op_code compare_code(const lex l, const bool select) {
+			switch (l) {
+				case lex::less:       return select ? vm::op_code::select_lt : vm::op_code::lt;
+				case lex::less_equal: return select ? vm::op_code::select_le : vm::op_code::le;
+				case lex::more:       return select ? vm::op_code::select_gt : vm::op_code::gt;
+				case lex::more_equal: return select ? vm::op_code::select_ge : vm::op_code::ge;
+				default:              return select ? vm::op_code::select_eq : vm::op_code::eq;
+			}
+		}
+
+		// forces operand into register
+		uint32_t materialize(const operand& op) {
+			release(op);
+			const uint32_t dst = alloc(op.type);
+			switch (op.k) {
+				case operand::kind::reg:
+					return op.x; // released and taken back
+				case operand::kind::var:
+					return emit({ .code = vm::op_code::ld_var, .dst = dst, .a = op.x });
+				case operand::kind::imm:
+					return emit({ .code = op.type == value_type::num ? vm::op_code::ld_const : vm::op_code::ld_bool, .dst = dst, .imm = op.imm });
+				case operand::kind::product:
+					return emit({ .code = vm::op_code::mul, .dst = dst, .a = op.x, .b = op.y });
+				case operand::kind::compare:
+					return emit({ .code = compare_code(op.cmp, false), .dst = dst, .a = op.x, .b = op.y });
+			}
+			return dst;
+		}
+
+		static operand reg(const uint32_t r, const value_type t = value_type::num) {
+			return { .k = operand::kind::reg, .type = t, .x = r };
+		}
+
+		static bool is_imm(const operand& op, const num_t v) { return op.k == operand::kind::imm && op.imm == v; }
+		// zero of given sign, x+0 turns -0 into +0 so only x-0 and x+(-0) leave x as it is
+		static bool is_zero(const operand& op, const bool negative) { return is_imm(op, 0) && std::signbit(op.imm) == negative; }
+
+		static bool is_power_of_two(const num_t v) {
+			int exp = 0;
+			return std::frexp(v, &exp) == num_t{ 0.5 } && std::isnormal(num_t{ 1 } / v);
+		}
+
+		operand gen_arith(lex l, const operand& lhs, operand rhs) {
+			using k = operand::kind;
+
+			// identities x*1, 1*x, x/1, x-0, x+(-0), (-0)+x
+			if ((is_imm(rhs, 1) && (l == lex::multiply || l == lex::divide)) || (l == lex::minus && is_zero(rhs, false)) || (l == lex::plus && is_zero(rhs, true)))
+				return lhs;
+			if ((is_imm(lhs, 1) && l == lex::multiply) || (l == lex::plus && is_zero(lhs, true)))
+				return rhs;
+
+			// x/c as x*(1/c), exact for powers of two
+			if (l == lex::divide && rhs.k == k::imm && (_options.reciprocal_division || is_power_of_two(rhs.imm))) {
+				l = lex::multiply;
+				rhs.imm = num_t{ 1 } / rhs.imm;
+			}
+			const bool commutative = l == lex::plus || l == lex::multiply;
+
+			// a*b+c
+			if (l == lex::plus && (lhs.k == k::product || rhs.k == k::product)) {
+				const operand& prod = lhs.k == k::product ? lhs : rhs;
+				const operand& other = lhs.k == k::product ? rhs : lhs;
+				const uint32_t c = materialize(other);
+				release(prod);
+				_free_num.push_back(c);
+				return reg(emit({ .code = vm::op_code::fma, .dst = alloc(value_type::num), .a = prod.x, .b = prod.y, .c = c }));
+			}
+
+			const auto rc = [l](const bool reversed) {
+				switch (l) {
+					case lex::plus:     return vm::op_code::add_rc;
+					case lex::minus:    return reversed ? vm::op_code::sub_cr : vm::op_code::sub_rc;
+					case lex::multiply: return vm::op_code::mul_rc;
+					default:            return reversed ? vm::op_code::div_cr : vm::op_code::div_rc;
+				}
+			};
+			const auto vc = [l](const bool reversed) {
+				switch (l) {
+					case lex::plus:     return vm::op_code::add_vc;
+					case lex::minus:    return reversed ? vm::op_code::sub_cv : vm::op_code::sub_vc;
+					case lex::multiply: return vm::op_code::mul_vc;
+					default:            return reversed ? vm::op_code::div_cv : vm::op_code::div_vc;
+				}
+			};
+
+			// one side is constant
+			if (rhs.k == k::imm || (lhs.k == k::imm && rhs.k != k::imm)) {
+				const bool reversed = lhs.k == k::imm && rhs.k != k::imm;
+				const operand& c = reversed ? rhs : lhs; // not constant side
+				const num_t imm = reversed ? lhs.imm : rhs.imm;
+				if (c.k == k::var)
+					return reg(emit({ .code = vc(reversed && !commutative), .dst = alloc(value_type::num), .a = c.x, .imm = imm }));
+
+				const uint32_t a = materialize(c);
+				_free_num.push_back(a);
+				return reg(emit({ .code = rc(reversed && !commutative), .dst = alloc(value_type::num), .a = a, .imm = imm }));
+			}
+
+			const uint32_t a = materialize(lhs);
+			const uint32_t b = materialize(rhs);
+			if (l == lex::multiply)
+				return { .k = k::product, .x = a, .y = b };
+
+			_free_num.push_back(b);
+			_free_num.push_back(a);
+			vm::op_code code = l == lex::plus ? vm::op_code::add : l == lex::minus ? vm::op_code::sub : vm::op_code::div;
+			return reg(emit({ .code = code, .dst = alloc(value_type::num), .a = a, .b = b }));
+		}
+
+		operand gen_power(const operand& base, const operand& exponent) {
+			constexpr num_t max_chain = 64;
+			if (exponent.k == operand::kind::imm) {
+				const num_t e = exponent.imm;
+				if (e == num_t{ 0 }) return { .k = operand::kind::imm, .imm = 1 }; // pow(x, 0) is 1 even for NaN
+				if (e == num_t{ 1 }) return base;
+				if (e == num_t{ 0.5 }) {
+					const uint32_t a = materialize(base);
+					_free_num.push_back(a);
+					return reg(emit({ .code = vm::op_code::sqrt, .dst = alloc(value_type::num), .a = a }));
+				}
+				if (e == num_t{ -1 }) { // one rounding like pow, other negative powers would overflow in x^n before 1/x^n
+					const uint32_t a = materialize(base);
+					_free_num.push_back(a);
+					return reg(emit({ .code = vm::op_code::div_cr, .dst = alloc(value_type::num), .a = a, .imm = 1 }));
+				}
+				if (e == std::trunc(e) && e > 0 && e <= max_chain) {
+					const auto n = static_cast<unsigned>(e);
+					const uint32_t b = materialize(base);
+					if (n == 2)
+						return { .k = operand::kind::product, .x = b, .y = b }; // x^2 may still fuse into fma
+
+					// left to right binary exponentiation
+					int bit = 31;
+					while (!((n >> bit) & 1u)) --bit;
+					uint32_t acc = b;
+					while (bit-- > 0) {
+						const uint32_t d = acc == b ? alloc(value_type::num) : acc;
+						acc = emit({ .code = vm::op_code::mul, .dst = d, .a = acc, .b = acc });
+						if ((n >> bit) & 1u)
+							emit({ .code = vm::op_code::mul, .dst = acc, .a = acc, .b = b });
+					}
+					if (acc != b) _free_num.push_back(b);
+					return reg(acc);
+				}
+			}
+
+			const uint32_t a = materialize(base);
+			const uint32_t b = materialize(exponent);
+			_free_num.push_back(b);
+			_free_num.push_back(a);
+			return reg(emit({ .code = vm::op_code::call2, .dst = alloc(value_type::num), .a = a, .b = b, .fn = { .f2 = op_defs::pow_f } }));
+		}
+
+		// leaf goes to operand stack right away, inner node gets frame and is finished once its children are done
+		std::variant<std::monostate, error> enter(size_t n) {
+			// --x
+			while (_postfix[_nodes[n].tok].lex_type == lex::unary_minus) {
+				const node& child = _nodes[_children[_nodes[n].first_child]];
+				if (_postfix[child.tok].lex_type != lex::unary_minus) break;
+				n = _children[child.first_child];
+			}
+			const node& nd = _nodes[n];
+			const lex_wrapper& lw = _postfix[nd.tok];
+
+			if (lw.lex_type == lex::number)
+				_operands.push_back({ .k = operand::kind::imm, .imm = lw.number() });
+			else if (lw.lex_type == lex::boolean)
+				_operands.push_back({ .k = operand::kind::imm, .type = value_type::boolean, .imm = lw.boolean() ? num_t{ 1 } : num_t{ 0 } });
+			else if (lw.lex_type == lex::variable) {
+				const auto it = _slots.find(lw.name());
+				if (it == _slots.end()) return error::unknown_token;
+				_operands.push_back({ .k = operand::kind::var, .x = static_cast<uint32_t>(it->second) });
+			}
+			else if (lw.lex_type == lex::constant) {
+				const Term term = std::get<Term>(resolve_term(lw));
+				_operands.push_back(reg(emit({ .code = vm::op_code::call0, .dst = alloc(value_type::num), .fn = { .f0 = std::get<num_empty_t>(term) } })));
+			}
+			else {
+				frame::kind k = frame::kind::eager;
+				if (!_options.branchless && lw.lex_type == lex::function && lw.name() == lex_functions::iff &&
+					std::max(_nodes[_children[nd.first_child + 1]].cost, _nodes[_children[nd.first_child + 2]].cost) >= lazy_cost)
+					k = frame::kind::lazy_if;
+				else if (!_options.branchless && (lw.lex_type == lex::logic_and || lw.lex_type == lex::logic_or) && _nodes[_children[nd.first_child + 1]].cost >= lazy_cost)
+					k = frame::kind::short_circuit;
+				_frames.push_back({ .k = k, .n = n, .args = _operands.size() });
+			}
+			return std::monostate{};
+		}
+
+		operand pop_operand() {
+			const operand op = _operands.back();
+			_operands.pop_back();
+			return op;
+		}
+
+		// child f.next - 1 of lazy form is done: if(cond, a, b) jumps over untaken branch,
+		// a & b and a | b evaluate b only when a does not decide result
+		void between_children(frame& f) {
+			if (f.k == frame::kind::short_circuit) {
+				f.dst = materialize(pop_operand());
+				f.jump = _program.size();
+				_program.push_back({ .code = _postfix[_nodes[f.n].tok].lex_type == lex::logic_and ? vm::op_code::jump_unless : vm::op_code::jump_if, .a = f.dst });
+			}
+			else if (f.next == 1) {
+				f.jump = emit_jump_unless(pop_operand());
+				f.dst = alloc(value_type::num);
+			}
+			else {
+				materialize_into(pop_operand(), f.dst);
+				const size_t to_end = _program.size();
+				_program.push_back({ .code = vm::op_code::jump });
+				patch(f.jump);
+				f.jump = to_end;
+			}
+		}
+
+		// depth first over tree with explicit stacks, so long chains like a+a+...+a do not exhaust call stack
+		std::variant<operand, error> gen(const size_t root) {
+			if (const auto res = enter(root); res.index() == 1) return std::get<error>(res);
+			while (!_frames.empty()) {
+				frame& f = _frames.back();
+				const node& nd = _nodes[f.n];
+				if (f.next < nd.n_children) {
+					if (f.next > 0 && f.k != frame::kind::eager) between_children(f);
+					const size_t child = _children[nd.first_child + f.next++];
+					if (const auto res = enter(child); res.index() == 1) return std::get<error>(res); // f may dangle from here
+					continue;
+				}
+
+				const frame done = f;
+				_frames.pop_back();
+				operand result;
+				if (done.k == frame::kind::eager)
+					result = finish(nd, std::span<operand>{ _operands }.subspan(done.args));
+				else {
+					materialize_into(pop_operand(), done.dst);
+					patch(done.jump);
+					result = reg(done.dst, done.k == frame::kind::short_circuit ? value_type::boolean : value_type::num);
+				}
+				_operands.resize(done.args);
+				_operands.push_back(result);
+			}
+			return _operands.back();
+		}
+
+		// operand of node whose children are evaluated to args
+		operand finish(const node& nd, std::span<operand> args) {
+			const lex_wrapper& lw = _postfix[nd.tok];
+			switch (lw.lex_type) {
+				case lex::plus: case lex::minus: case lex::multiply: case lex::divide:
+					return gen_arith(lw.lex_type, args[0], args[1]);
+				case lex::unary_minus: {
+					const uint32_t a = materialize(args[0]);
+					_free_num.push_back(a);
+					return reg(emit({ .code = vm::op_code::neg, .dst = alloc(value_type::num), .a = a }));
+				}
+				case lex::less: case lex::less_equal: case lex::more: case lex::more_equal: case lex::equal: {
+					const uint32_t a = materialize(args[0]);
+					const uint32_t b = materialize(args[1]);
+					return operand{ .k = operand::kind::compare, .type = value_type::boolean, .x = a, .y = b, .cmp = lw.lex_type };
+				}
+				case lex::logic_and: case lex::logic_or: case lex::logic_xor: {
+					const uint32_t a = materialize(args[0]);
+					const uint32_t b = materialize(args[1]);
+					_free_bool.push_back(b);
+					_free_bool.push_back(a);
+					const vm::op_code code = lw.lex_type == lex::logic_and ? vm::op_code::logic_and : lw.lex_type == lex::logic_or ? vm::op_code::logic_or : vm::op_code::logic_xor;
+					return reg(emit({ .code = code, .dst = alloc(value_type::boolean), .a = a, .b = b }), value_type::boolean);
+				}
+				case lex::power:
+					return gen_power(args[0], args[1]);
+				case lex::function:
+					break;
+				default: {
+					// remaining operators go through their function
+					const Term term = std::get<Term>(resolve_term(lw));
+					const uint32_t a = materialize(args[0]);
+					const uint32_t b = materialize(args[1]);
+					_free_num.push_back(b);
+					_free_num.push_back(a);
+					return reg(emit({ .code = vm::op_code::call2, .dst = alloc(value_type::num), .a = a, .b = b, .fn = { .f2 = std::get<num_2num_t>(term) } }));
+				}
+			}
+
+			const Term term = std::get<Term>(resolve_term(lw));
+			if (std::holds_alternative<num_1bool_2num_t>(term)) {
+				// if(cond, a, b)
+				const operand& cond = args[0];
+				const uint32_t c = materialize(args[1]);
+				const uint32_t e = materialize(args[2]);
+				_free_num.push_back(e);
+				_free_num.push_back(c);
+				if (cond.k == operand::kind::compare) {
+					release(cond);
+					return reg(emit({ .code = compare_code(cond.cmp, true), .dst = alloc(value_type::num), .a = cond.x, .b = cond.y, .c = c, .e = e }));
+				}
+				const uint32_t a = materialize(cond);
+				_free_bool.push_back(a);
+				return reg(emit({ .code = vm::op_code::select, .dst = alloc(value_type::num), .a = a, .b = c, .c = e }));
+			}
+			if (std::holds_alternative<num_1num_t>(term)) {
+				const auto f = std::get<num_1num_t>(term);
+				if (args[0].k == operand::kind::var)
+					return reg(emit({ .code = vm::op_code::call1_v, .dst = alloc(value_type::num), .a = args[0].x, .fn = { .f1 = f } }));
+				const uint32_t a = materialize(args[0]);
+				_free_num.push_back(a);
+				return reg(emit({ .code = vm::op_code::call1, .dst = alloc(value_type::num), .a = a, .fn = { .f1 = f } }));
+			}
+			if (std::holds_alternative<num_empty_t>(term))
+				return reg(emit({ .code = vm::op_code::call0, .dst = alloc(value_type::num), .fn = { .f0 = std::get<num_empty_t>(term) } }));
+
+			// two or more numbers, min and max fold pairwise from last argument like rpn_compute does
+			const auto f = std::get<num_2num_t>(term);
+			const auto& name = lw.name();
+			const vm::op_code code = name == lex_functions::min ? vm::op_code::min : name == lex_functions::max ? vm::op_code::max : vm::op_code::call2;
+			if (args.size() > 2)
+				std::ranges::reverse(args);
+			uint32_t acc = materialize(args[0]);
+			for (size_t i = 1; i < args.size(); ++i) {
+				const uint32_t b = materialize(args[i]);
+				_free_num.push_back(b);
+				_free_num.push_back(acc);
+				acc = emit({ .code = code, .dst = alloc(value_type::num), .a = acc, .b = b, .fn = { .f2 = f } });
+			}
+			return reg(acc);
+		}
+
+	public:
+		codegen(std::span<const lex_wrapper> postfix, const slot_map& slots, const compile_options& options,
+			std::pmr::memory_resource* mr = std::pmr::get_default_resource()) :
+			_postfix(postfix), _slots(slots), _options(options), _mr(mr), _nodes(mr), _children(mr), _frames(mr), _operands(mr), _free_num(mr), _free_bool(mr) {}
+
+		struct result {
+			std::vector<vm::instruction> program;
+			uint32_t n_num;
+			uint32_t n_bool;
+			uint32_t result_reg;
+			value_type result_type;
+		};
+
+		[[nodiscard]] std::variant<result, error> run() {
+			const auto types = infer_types(_postfix, _mr);
+			if (types.index() == 1) return std::get<error>(types);
+
+			// rebuild expression tree from postfix, children of node are in call order
+			std::pmr::vector<size_t> st(_mr);
+			_nodes.reserve(_postfix.size());
+			_children.reserve(_postfix.size());
+			_program.reserve(_postfix.size() + 1);
+			for (size_t idx = 0, n = _postfix.size(); idx < n; ++idx) {
+				const lex_wrapper& lw = _postfix[idx];
+				if (is_postfix_noop(lw.lex_type)) continue;
+
+				const size_t n_args = lw.lex_type == lex::number || lw.lex_type == lex::boolean || lw.lex_type == lex::variable ? 0 : lw.n_args;
+				size_t cost = lw.lex_type == lex::function || lw.lex_type == lex::constant || lw.lex_type == lex::power ? call_cost : n_args > 0 ? 1 : 0;
+				for (auto it = st.end() - static_cast<std::ptrdiff_t>(n_args); it != st.end(); ++it)
+					cost += _nodes[*it].cost;
+
+				node nd{ idx, std::get<0>(types)[idx], _children.size(), n_args, cost };
+				_children.insert(_children.end(), st.end() - static_cast<std::ptrdiff_t>(n_args), st.end());
+				st.erase(st.end() - static_cast<std::ptrdiff_t>(n_args), st.end());
+				st.push_back(_nodes.size());
+				_nodes.push_back(nd);
+			}
+
+			const auto root = gen(st.back());
+			if (root.index() == 1) return std::get<error>(root);
+
+			const operand& op = std::get<operand>(root);
+			const uint32_t r = materialize(op);
+			return result{ std::move(_program), std::max<uint32_t>(_n_num, 1), std::max<uint32_t>(_n_bool, 1), r, op.type };
+		}
+	};
+}
@@ -15,4 +15,7 @@ namespace defs {
   typedef fn_ptr_t<num_t, bool_t, num_t, num_t> num_1bool_2num_t;
   typedef fn_ptr_t<bool_t, num_t, num_t>        bool_2num_t;
   typedef fn_ptr_t<bool_t, bool_t, bool_t>      bool_2bool_t;
+
+  // static type of a value produced by a (sub)expression
+  enum class value_type { num, boolean };
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <variant>
+#include <span>
+#include <unordered_map>
+#include <memory>
+#include <memory_resource>
+
+#include "maps.h"
+#include "codegen.h"
+#include "optimizer.h"
+#include "vm.h"
+#include "jit.h"
+
+namespace solver
+{
+	// postfix program produced once from the output of shunting_yard::run.
+	// operators, functions and constants are resolved at compile time so evaluate() only walks the program.
+	// every variable is resolved to a slot, evaluate() reads its value from a contiguous array at that slot.
+	// program is type checked on compilation and lowered to register program of vm (see codegen.h)
+	class compiled_expression
+	{
+		static constexpr size_t no_slot = static_cast<size_t>(-1);
+
+		std::vector<vm::instruction> _program;
+		std::vector<std::string> _slot_names; // empty when compiled against slot map of equation system
+		size_t _n_slots{ 0 };
+		uint32_t _n_num{ 0 };
+		uint32_t _n_bool{ 0 };
+		uint32_t _result_reg{ 0 };
+		value_type _result_type{ value_type::num };
+		std::shared_ptr<const jit::code> _native; // null when running on vm
+		jit::entry_t _entry{ nullptr };
+
+		compiled_expression() = default;
+
+		void execute(const num_t* vars, vm::registers& regs) const {
+			regs.reserve(_n_num, _n_bool);
+			if (_entry) _entry(vars, regs.num(), regs.boolean());
+			else vm::execute(_program, vars, regs.num(), regs.boolean());
+		}
+
+	public:
+		// slots maps variable names to their slots in array of n_slots values passed on evaluation.
+		// mr provides scratch memory of compilation, nothing allocated from it is referenced by result
+		[[nodiscard]] static std::variant<compiled_expression, error> compile(std::span<const lex_wrapper> postfix,
+			const slot_map& slots, const size_t n_slots, const compile_options& options = {},
+			std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+			// on mr already, so assigning result moves it instead of copying to another resource
+			std::variant<std::pmr::vector<lex_wrapper>, error> folded{ std::pmr::vector<lex_wrapper>(mr) };
+			if (options.fold_constants) {
+				folded = fold_constants(postfix, mr);
+				if (folded.index() == 1) return std::get<error>(folded);
+			}
+			const std::span<const lex_wrapper> program = options.fold_constants ? std::span<const lex_wrapper>{ std::get<0>(folded) } : postfix;
+
+			auto gen = codegen{ program, slots, options, mr }.run();
+			if (gen.index() == 1) return std::get<error>(gen);
+
+			auto& res = std::get<codegen::result>(gen);
+			compiled_expression ce;
+			ce._program = std::move(res.program);
+			ce._n_slots = n_slots;
+			ce._n_num = res.n_num;
+			ce._n_bool = res.n_bool;
+			ce._result_reg = res.result_reg;
+			ce._result_type = res.result_type;
+			if (options.jit && (ce._native = jit::compile(ce._program)))
+				ce._entry = ce._native->entry();
+			return ce;
+		}
+
+		// slot_names defines binding layout: variable slot_names[i] is read from vars[i] on evaluation
+		[[nodiscard]] static std::variant<compiled_expression, error> compile(std::span<const lex_wrapper> postfix, std::vector<std::string> slot_names,
+			const compile_options& options = {}, std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+			slot_map slots(mr);
+			slots.reserve(slot_names.size());
+			for (size_t i = 0, n = slot_names.size(); i < n; ++i)
+				slots.emplace(slot_names[i], i);
+
+			auto ce = compile(postfix, slots, slot_names.size(), options, mr);
+			if (ce.index() == 0)
+				std::get<0>(ce)._slot_names = std::move(slot_names);
+			return ce;
+		}
+
+		// slots are assigned to variables in order of their first appearance
+		[[nodiscard]] static std::variant<compiled_expression, error> compile(std::span<const lex_wrapper> postfix, const compile_options& options = {},
+			std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+			std::vector<std::string> slot_names;
+			for (const auto& lw : postfix) {
+				if (lw.lex_type != lex::variable) continue;
+				const auto& name = lw.name();
+				if (std::ranges::find(slot_names, name) == slot_names.end())
+					slot_names.push_back(name);
+			}
+			return compile(postfix, std::move(slot_names), options, mr);
+		}
+
+		// names of variables in slot order
+		[[nodiscard]] const std::vector<std::string>& slot_names() const { return _slot_names; }
+
+		[[nodiscard]] size_t slot_of(const std::string& name) const {
+			const auto it = std::ranges::find(_slot_names, name);
+			return it == _slot_names.end() ? no_slot : static_cast<size_t>(it - _slot_names.begin());
+		}
+
+		// values expected on evaluation
+		[[nodiscard]] size_t n_slots() const { return _n_slots; }
+
+		// slots program actually reads, ascending
+		[[nodiscard]] std::vector<size_t> used_slots() const {
+			std::vector<size_t> slots;
+			for (const auto& ins : _program) {
+				if (vm::reads_variable(ins.code)) slots.push_back(ins.a);
+			}
+			std::ranges::sort(slots);
+			slots.erase(std::ranges::unique(slots).begin(), slots.end());
+			return slots;
+		}
+
+		[[nodiscard]] value_type result_type() const { return _result_type; }
+
+		// register file layout, for runners other than evaluate() such as batch.h
+		[[nodiscard]] uint32_t n_num() const { return _n_num; }
+		[[nodiscard]] uint32_t n_bool() const { return _n_bool; }
+		[[nodiscard]] uint32_t result_reg() const { return _result_reg; }
+
+		[[nodiscard]] const std::vector<vm::instruction>& program() const { return _program; }
+
+		// false when compiled without jit or jit is not available, program then runs on vm
+		[[nodiscard]] bool is_native() const { return _entry != nullptr; }
+
+		// lay out named values in slot order, to be done once and then updated per slot
+		[[nodiscard]] std::variant<std::vector<num_t>, error> bind(const std::map<std::string, num_t>& vars) const {
+			std::vector<num_t> values(_slot_names.size());
+			for (size_t i = 0, n = _slot_names.size(); i < n; ++i) {
+				const auto it = vars.find(_slot_names[i]);
+				if (it == vars.end()) return error::unknown_token;
+				values[i] = it->second;
+			}
+			return values;
+		}
+
+		// evaluation with caller provided register file never allocates
+		// numeric result without any checks, vars has to hold all slots
+		[[nodiscard]] num_t evaluate_num(const num_t* vars, vm::registers& regs) const {
+			execute(vars, regs);
+			return regs.num()[_result_reg];
+		}
+
+		[[nodiscard]] std::variant<num_t, bool_t, error> evaluate(std::span<const num_t> vars, vm::registers& regs) const {
+			if (vars.size() < _n_slots) return error::out_of_range;
+
+			execute(vars.data(), regs);
+			if (_result_type == value_type::num)
+				return regs.num()[_result_reg];
+			return regs.boolean()[_result_reg];
+		}
+
+		// uses register file of calling thread
+		[[nodiscard]] std::variant<num_t, bool_t, error> evaluate(std::span<const num_t> vars) const {
+			thread_local vm::registers regs;
+			return evaluate(vars, regs);
+		}
+	};
+}
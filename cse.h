@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <string>
+#include <variant>
+#include <cstring>
+#include <unordered_map>
+
+#include "maps.h"
+#include "type_check.h"
+
+namespace solver
+{
+	// prefix of names given to shared subexpressions, cannot clash with identifiers of equations
+	inline static const std::string cse_prefix = "$";
+
+	// common subexpression elimination across all equations of a system.
+	// structurally identical subtrees are hash-consed into one DAG. every numeric subtree used from more than one place
+	// becomes its own equation (named cse_prefix + number, appended to names) and its occurrences turn into variable
+	// tokens referencing it, so it is evaluated once per evaluation of the system. subtree equal to whole equation is
+	// referenced by name of that equation instead. product consumed by addition always stays in place, so fusing it into
+	// fma does not depend on which other equations share it. equations have to be postfix without no-op tokens
+	[[nodiscard]] static std::variant<std::monostate, error> eliminate_common_subexpressions(std::vector<std::string>& names,
+		std::vector<std::vector<lex_wrapper>>& equations, symbol_table& symbols) {
+		struct dag_node {
+			lex_wrapper tok;
+			std::vector<size_t> children;
+			value_type type;
+			size_t uses{ 0 };
+			std::string name{}; // name node is referenced by when shared
+		};
+
+		std::vector<dag_node> dag;
+		std::unordered_map<std::string, size_t> index; // structural key to dag node
+		std::vector<size_t> roots;
+
+		const auto key_of = [](const lex_wrapper& lw, const std::vector<size_t>& children) {
+			std::string key(1, static_cast<char>(lw.lex_type));
+			if (lw.lex_type == lex::number) {
+				char bits[sizeof(num_t)];
+				const num_t d = lw.number();
+				std::memcpy(bits, &d, sizeof(num_t));
+				key.append(bits, sizeof(num_t));
+			}
+			else if (lw.lex_type == lex::boolean)
+				key += lw.boolean() ? '1' : '0';
+			else if (lw.has_name())
+				key += lw.name();
+			key += '(';
+			for (const size_t c : children) {
+				key += std::to_string(c);
+				key += ',';
+			}
+			return key;
+		};
+
+		constexpr size_t none = static_cast<size_t>(-1);
+		const auto is_number = [&dag](const size_t i, const num_t v) {
+			return dag[i].tok.lex_type == lex::number && dag[i].tok.number() == v && std::signbit(dag[i].tok.number()) == std::signbit(v);
+		};
+		// child whose value node passes on unchanged, as codegen drops identities x*1, 1*x, x/1, x-0, x+(-0), (-0)+x
+		const auto passed_on = [is_number](const lex_wrapper& tok, const std::vector<size_t>& children) {
+			if (children.size() != 2) return none;
+			const size_t x = children[0], y = children[1];
+			switch (tok.lex_type) {
+				case lex::multiply: return is_number(y, 1) ? x : is_number(x, 1) ? y : none;
+				case lex::divide:   return is_number(y, 1) ? x : none;
+				case lex::plus:     return is_number(y, -0.0) ? x : is_number(x, -0.0) ? y : none;
+				case lex::minus:    return is_number(y, 0) ? x : none;
+				default:            return none;
+			}
+		};
+		const auto is_product = [&dag, passed_on](size_t i) {
+			for (size_t next; (next = passed_on(dag[i].tok, dag[i].children)) != none;) i = next;
+			return dag[i].tok.lex_type == lex::multiply;
+		};
+		// product reaching addition, directly or through identity, is evaluated in place instead of referenced
+		const auto in_place = [is_product, passed_on](const lex_wrapper& tok, const std::vector<size_t>& children, const size_t child) {
+			return is_product(child) && (tok.lex_type == lex::plus || passed_on(tok, children) == child);
+		};
+
+		// hash-cons every equation into dag
+		std::vector<size_t> st;
+		for (const auto& eq : equations) {
+			const auto types = infer_types(eq);
+			if (types.index() == 1) return std::get<error>(types);
+
+			st.clear();
+			for (size_t idx = 0, n = eq.size(); idx < n; ++idx) {
+				const lex_wrapper& lw = eq[idx];
+				const size_t n_args = lw.lex_type == lex::number || lw.lex_type == lex::boolean || lw.lex_type == lex::variable || lw.lex_type == lex::constant ? 0 : lw.n_args;
+				std::vector<size_t> children(st.end() - static_cast<std::ptrdiff_t>(n_args), st.end());
+				st.erase(st.end() - static_cast<std::ptrdiff_t>(n_args), st.end());
+
+				const auto [it, inserted] = index.try_emplace(key_of(lw, children), dag.size());
+				if (inserted) {
+					for (const size_t c : children) {
+						if (!in_place(lw, children, c)) ++dag[c].uses;
+					}
+					dag.push_back({ lw, std::move(children), std::get<0>(types)[idx] });
+				}
+				st.push_back(it->second);
+			}
+			if (st.size() != 1) return error::wrong_args_count;
+			roots.push_back(st.back());
+			++dag[st.back()].uses;
+		}
+
+		// name shared nodes, numeric equations keep their own names
+		const auto is_named_root = [&](const size_t i) { return !dag[roots[i]].children.empty() && dag[roots[i]].type == value_type::num; };
+		for (size_t i = 0, n = roots.size(); i < n; ++i) {
+			if (is_named_root(i) && dag[roots[i]].name.empty())
+				dag[roots[i]].name = names[i];
+		}
+		std::vector<size_t> shared;
+		for (size_t i = 0, n = dag.size(); i < n; ++i) {
+			dag_node& nd = dag[i];
+			if (nd.uses < 2 || nd.children.empty() || nd.type != value_type::num || !nd.name.empty()) continue;
+			nd.name = cse_prefix + std::to_string(shared.size());
+			shared.push_back(i);
+		}
+
+		// re-emit postfix, references to shared nodes other than the one being defined become variables
+		const auto emit = [&dag, &symbols, in_place](const size_t root) {
+			std::vector<lex_wrapper> out;
+			std::vector<std::pair<size_t, size_t>> work{ { root, 0 } }; // node, next child to visit
+			while (!work.empty()) {
+				auto& [id, next] = work.back();
+				const dag_node& nd = dag[id];
+				if (next < nd.children.size()) {
+					const size_t c = nd.children[next++];
+					if (!dag[c].name.empty() && !in_place(nd.tok, nd.children, c))
+						out.emplace_back(lex::variable, symbols.intern(dag[c].name));
+					else
+						work.emplace_back(c, 0);
+				}
+				else {
+					out.push_back(nd.tok);
+					work.pop_back();
+				}
+			}
+			return out;
+		};
+
+		for (size_t i = 0, n = equations.size(); i < n; ++i) {
+			// equation identical to an earlier one just references it
+			if (is_named_root(i) && dag[roots[i]].name != names[i])
+				equations[i] = { lex_wrapper{ lex::variable, symbols.intern(dag[roots[i]].name) } };
+			else
+				equations[i] = emit(roots[i]);
+		}
+		for (const size_t id : shared) {
+			names.push_back(dag[id].name);
+			equations.push_back(emit(id));
+		}
+		return std::monostate{};
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+
+#include "maps.h"
+
+namespace solver
+{
+	// adjacency in compressed sparse row form: edges of vertex i are targets[offsets[i]] .. targets[offsets[i + 1] - 1]
+	struct csr_graph {
+		std::vector<size_t> offsets{ 0 };
+		std::vector<size_t> targets;
+
+		[[nodiscard]] size_t size() const { return offsets.size() - 1; }
+		[[nodiscard]] size_t n_edges() const { return targets.size(); }
+		[[nodiscard]] std::span<const size_t> operator[](const size_t i) const {
+			return { targets.data() + offsets[i], offsets[i + 1] - offsets[i] };
+		}
+	};
+
+	// edge i -> j when equation i references equation j, every edge once and targets of a vertex ascending.
+	// names are resolved through one hash index, so cost is linear in total number of tokens
+	[[nodiscard]] inline csr_graph build_dependency_graph(const std::vector<std::string>& names, const std::vector<std::vector<defs::lex_wrapper>>& equations) {
+		const size_t n = names.size();
+		std::unordered_map<std::string_view, size_t> index;
+		index.reserve(n);
+		for (size_t i = 0; i < n; ++i)
+			index.emplace(names[i], i);
+
+		csr_graph g;
+		g.offsets.reserve(n + 1);
+		std::vector<size_t> last_from(n, static_cast<size_t>(-1)); // dedups references within one equation
+		for (size_t i = 0; i < n; ++i) {
+			const size_t begin = g.targets.size();
+			for (const auto& lw : equations[i]) {
+				if (lw.lex_type != defs::lex::variable) continue;
+				const auto it = index.find(lw.name());
+				if (it == index.end() || last_from[it->second] == i) continue;
+				last_from[it->second] = i;
+				g.targets.push_back(it->second);
+			}
+			std::sort(g.targets.begin() + static_cast<std::ptrdiff_t>(begin), g.targets.end());
+			g.offsets.push_back(g.targets.size());
+		}
+		return g;
+	}
+}
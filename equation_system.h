@@ -0,0 +1,364 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <span>
+#include <variant>
+#include <unordered_map>
+#include <queue>
+#include <functional>
+#include <cstring>
+#include <optional>
+#include <numeric>
+
+#include "tokenizer.h"
+#include "compiled_expression.h"
+#include "arena.h"
+#include "memo.h"
+#include "thread_pool.h"
+
+namespace solver
+{
+	// every equation of a system compiled once and evaluated in dependency order.
+	// values live in one array: inputs first, then one slot per equation (shared subexpressions last).
+	// equations read values of inputs and of other equations directly from their slots.
+	// after set() of some inputs recompute() evaluates only equations depending on them
+	class equation_system
+	{
+		std::vector<std::string> _slot_names;
+		size_t _n_inputs{ 0 };
+		size_t _n_equations{ 0 }; // equations of the system, shared subexpressions follow them
+		std::vector<compiled_expression> _equations; // equation i writes slot _n_inputs + i
+		std::vector<size_t> _order;
+		std::unordered_map<std::string, size_t> _slots;
+
+		std::vector<num_t> _values;
+		vm::registers _regs;
+
+		// incremental recomputation
+		std::vector<std::vector<size_t>> _dependents; // _dependents[slot] lists equations reading that slot
+		std::vector<size_t> _rank;                   // position of equation in _order
+		std::vector<char> _dirty;                    // per equation
+		std::priority_queue<size_t, std::vector<size_t>, std::greater<>> _pending; // ranks of dirty equations
+		std::vector<size_t> _changed;
+		bool _evaluated{ false };
+
+		// parallel evaluation
+		std::vector<uint32_t> _n_deps; // number of distinct equations read by equation
+		std::vector<vm::registers> _worker_regs;
+
+		// demand driven evaluation
+		struct selection {
+			std::vector<size_t> order;   // equations needed by requested outputs, in evaluation order
+			std::vector<size_t> outputs; // slots of requested outputs in requested order
+		};
+		csr_graph _graph; // equations read by equation
+		std::vector<selection> _selections;
+		std::map<std::vector<size_t>, size_t> _selection_index; // requested equations to their selection
+		std::vector<num_t> _selected;
+
+		// memoization, off until memoize()
+		std::optional<memo_table> _memo;                      // values of all equations by inputs
+		std::vector<std::optional<memo_table>> _equation_memo; // value of expensive equation by slots it reads
+
+		equation_system() = default;
+
+		// value of equation i from current values, through its memo table when it has one
+		num_t evaluate_equation(const size_t i, vm::registers& regs) {
+			const num_t* const values = _values.data();
+			if (i >= _equation_memo.size() || !_equation_memo[i])
+				return _equations[i].evaluate_num(values, regs);
+
+			memo_table& memo = *_equation_memo[i];
+			if (const num_t* hit = memo.find(values)) return *hit;
+			const num_t v = _equations[i].evaluate_num(values, regs);
+			memo.store(values, &v);
+			return v;
+		}
+
+		// values of all equations for current inputs from memo, false when not memoized or not there
+		bool recall() {
+			const num_t* hit = _memo ? _memo->find(_values.data()) : nullptr;
+			if (hit) std::copy_n(hit, _equations.size(), _values.begin() + static_cast<std::ptrdiff_t>(_n_inputs));
+			return hit != nullptr;
+		}
+
+		void remember() {
+			if (_memo) _memo->store(_values.data(), _values.data() + _n_inputs);
+		}
+
+		std::span<const num_t> run() {
+			if (recall()) return evaluated();
+			for (const size_t i : _order)
+				_values[_n_inputs + i] = evaluate_equation(i, _regs);
+			remember();
+			return evaluated();
+		}
+
+		// everything is up to date after full evaluation
+		std::span<const num_t> evaluated() {
+			while (!_pending.empty()) _pending.pop();
+			std::ranges::fill(_dirty, 0);
+			_evaluated = true;
+			return { _values.data() + _n_inputs, _n_equations };
+		}
+
+		void mark_dependents(const size_t slot) {
+			for (const size_t i : _dependents[slot]) {
+				if (_dirty[i]) continue;
+				_dirty[i] = 1;
+				_pending.push(_rank[i]);
+			}
+		}
+
+		// bitwise, so 0 and -0 differ (1/x tells them apart) while NaN replaced by same NaN is not a change
+		static bool same_value(const num_t a, const num_t b) { return std::memcmp(&a, &b, sizeof(num_t)) == 0; }
+
+	public:
+		[[nodiscard]] static std::variant<equation_system, error> compile(const equation_set& set, const compile_options& options = {}) {
+			equation_system sys;
+			sys._n_inputs = set.inputs.size();
+			sys._n_equations = set.n_equations;
+			sys._order = set.order;
+			sys._slot_names = set.inputs;
+			sys._slot_names.insert(sys._slot_names.end(), set.names.begin(), set.names.end());
+			for (size_t i = 0, n = sys._slot_names.size(); i < n; ++i)
+				sys._slots.emplace(sys._slot_names[i], i);
+
+			sys._graph = set.graph;
+			sys._equations.reserve(set.postfix.size());
+			slot_map slots;
+			slots.reserve(sys._slot_names.size());
+			for (size_t i = 0, n = sys._slot_names.size(); i < n; ++i)
+				slots.emplace(sys._slot_names[i], i);
+			arena scratch;
+			for (const auto& postfix : set.postfix) {
+				scratch.reset();
+				auto ce = compiled_expression::compile(postfix, slots, sys._slot_names.size(), options, scratch.resource());
+				if (ce.index() == 1) return std::get<error>(ce);
+				// slots hold numbers only
+				if (std::get<0>(ce).result_type() != value_type::num) return error::wrong_type;
+				sys._equations.push_back(std::move(std::get<0>(ce)));
+			}
+
+			sys._dependents.resize(sys._slot_names.size());
+			sys._n_deps.assign(sys._equations.size(), 0);
+			for (size_t i = 0, n = set.postfix.size(); i < n; ++i) {
+				for (const auto& lw : set.postfix[i]) {
+					if (lw.lex_type != lex::variable) continue;
+					const size_t slot = sys._slots.at(lw.name());
+					auto& deps = sys._dependents[slot];
+					if (!deps.empty() && deps.back() == i) continue;
+					deps.push_back(i);
+					if (slot >= sys._n_inputs) ++sys._n_deps[i];
+				}
+			}
+			sys._rank.resize(sys._order.size());
+			for (size_t r = 0, n = sys._order.size(); r < n; ++r)
+				sys._rank[sys._order[r]] = r;
+			sys._dirty.assign(sys._equations.size(), 0);
+
+			sys._values.assign(sys._slot_names.size(), num_t{ 0 });
+			return sys;
+		}
+
+		[[nodiscard]] static std::variant<equation_system, error> compile(const tokenizer& parser, const compile_options& options = {}) {
+			const auto set = parser.parse();
+			if (set.index() == 1) return std::get<error>(set);
+			return compile(std::get<0>(set), options);
+		}
+
+		// input names in the order evaluate() expects their values
+		[[nodiscard]] std::span<const std::string> inputs() const { return { _slot_names.data(), _n_inputs }; }
+
+		// equation names in the order of values returned by evaluate()
+		[[nodiscard]] std::span<const std::string> names() const { return { _slot_names.data() + _n_inputs, _n_equations }; }
+
+		// evaluates all equations once, returned values are valid until next evaluation
+		[[nodiscard]] std::variant<std::span<const num_t>, error> evaluate(std::span<const num_t> inputs) {
+			if (inputs.size() < _n_inputs) return error::out_of_range;
+
+			std::copy_n(inputs.begin(), _n_inputs, _values.begin());
+			return run();
+		}
+
+		// independent equations are evaluated concurrently on pool. every equation is still evaluated exactly once
+		// from the same values of its dependencies, so results do not depend on number of threads or scheduling
+		[[nodiscard]] std::variant<std::span<const num_t>, error> evaluate(std::span<const num_t> inputs, work_stealing_pool& pool) {
+			if (inputs.size() < _n_inputs) return error::out_of_range;
+
+			std::copy_n(inputs.begin(), _n_inputs, _values.begin());
+			if (pool.size() == 1) return run(); // nothing to steal, topological order is cheaper
+			if (recall()) return evaluated();
+
+			if (_worker_regs.size() < pool.size())
+				_worker_regs.resize(pool.size());
+
+			num_t* const values = _values.data();
+			// memo tables of equations are not shared between workers, whole system is memoized still
+			pool.run(_n_deps, std::span<const std::vector<size_t>>{ _dependents }.subspan(_n_inputs),
+				[this, values](const size_t i, const size_t worker) {
+					values[_n_inputs + i] = _equations[i].evaluate_num(values, _worker_regs[worker]);
+				});
+			remember();
+			return evaluated();
+		}
+
+		[[nodiscard]] std::variant<std::span<const num_t>, error> evaluate(const std::map<std::string, num_t>& inputs) {
+			for (size_t i = 0; i < _n_inputs; ++i) {
+				const auto it = inputs.find(_slot_names[i]);
+				if (it == inputs.end()) return error::unknown_token;
+				_values[i] = it->second;
+			}
+			return run();
+		}
+
+		// prepares evaluation of just given outputs: upstream cone of equations they depend on is computed once
+		// and cached, returned id is passed to evaluate(). same outputs in same order give same id
+		[[nodiscard]] std::variant<size_t, error> select(std::span<const std::string> outputs) {
+			std::vector<size_t> requested;
+			for (const auto& name : outputs) {
+				const auto it = _slots.find(name);
+				if (it == _slots.end() || it->second < _n_inputs) return error::unknown_token;
+				requested.push_back(it->second - _n_inputs);
+			}
+			if (const auto it = _selection_index.find(requested); it != _selection_index.end())
+				return it->second;
+
+			std::vector<char> needed(_equations.size(), 0);
+			std::vector<size_t> st;
+			for (const size_t i : requested) {
+				if (needed[i]) continue;
+				needed[i] = 1;
+				st.push_back(i);
+				while (!st.empty()) {
+					const size_t v = st.back();
+					st.pop_back();
+					for (const size_t j : _graph[v]) {
+						if (needed[j]) continue;
+						needed[j] = 1;
+						st.push_back(j);
+					}
+				}
+			}
+
+			selection sel;
+			for (const size_t i : _order)
+				if (needed[i]) sel.order.push_back(i);
+			for (const size_t i : requested)
+				sel.outputs.push_back(_n_inputs + i);
+			_selections.push_back(std::move(sel));
+			_selection_index.emplace(std::move(requested), _selections.size() - 1);
+			return _selections.size() - 1;
+		}
+
+		// number of equations evaluated for selection
+		[[nodiscard]] size_t selection_size(const size_t selection_id) const { return _selections[selection_id].order.size(); }
+
+		// evaluates only equations selected outputs depend on, returns their values in requested order.
+		// equations outside of selection keep their previous values
+		[[nodiscard]] std::variant<std::span<const num_t>, error> evaluate(const size_t selection_id, std::span<const num_t> inputs) {
+			if (selection_id >= _selections.size() || inputs.size() < _n_inputs) return error::out_of_range;
+
+			std::copy_n(inputs.begin(), _n_inputs, _values.begin());
+			const selection& sel = _selections[selection_id];
+			num_t* const values = _values.data();
+			for (const size_t i : sel.order)
+				values[_n_inputs + i] = evaluate_equation(i, _regs);
+
+			_evaluated = false; // rest is stale, next recompute() runs everything
+			_selected.resize(sel.outputs.size());
+			for (size_t k = 0, n = sel.outputs.size(); k < n; ++k)
+				_selected[k] = values[sel.outputs[k]];
+			return std::span<const num_t>{ _selected };
+		}
+
+		// changes single input, equations depending on it are recomputed by next recompute()
+		void set(const size_t input, const num_t value) {
+			if (same_value(_values[input], value)) return;
+			_values[input] = value;
+			mark_dependents(input);
+		}
+
+		[[nodiscard]] std::variant<std::monostate, error> set(const std::string& name, const num_t value) {
+			const auto it = _slots.find(name);
+			if (it == _slots.end()) return error::unknown_token;
+			if (it->second >= _n_inputs) return error::wrong_type; // equations are not assignable
+			set(it->second, value);
+			return std::monostate{};
+		}
+
+		// re-evaluates only dirty equations in topological order. equation whose value did not change
+		// does not make its dependents dirty, so propagation stops as soon as values settle.
+		// returns indices (into names()) of equations whose value changed, valid until next recompute
+		std::span<const size_t> recompute() {
+			_changed.clear();
+			if (!_evaluated) {
+				run();
+				for (size_t i = 0; i < _n_equations; ++i) _changed.push_back(i);
+				return _changed;
+			}
+
+			num_t* const values = _values.data();
+			while (!_pending.empty()) {
+				const size_t i = _order[_pending.top()];
+				_pending.pop();
+				_dirty[i] = 0;
+
+				const size_t slot = _n_inputs + i;
+				const num_t v = evaluate_equation(i, _regs);
+				if (same_value(values[slot], v)) continue;
+				values[slot] = v;
+				mark_dependents(slot);
+				if (i < _n_equations) _changed.push_back(i);
+			}
+			return _changed;
+		}
+
+		// opt-in memoization of results by exact values they were computed from (see memo.h).
+		// evaluate() of whole system looks up values of all equations by inputs, with options.equations
+		// every equation calling at least options.min_calls functions is looked up by slots it reads too,
+		// which is where partial hits come from when only some inputs repeat. earlier tables are dropped
+		void memoize(const memo_options& options) {
+			_memo.reset();
+			_equation_memo.clear();
+			if (options.entries == 0) return;
+
+			std::vector<size_t> inputs(_n_inputs);
+			std::iota(inputs.begin(), inputs.end(), size_t{ 0 });
+			_memo.emplace(std::move(inputs), _equations.size(), options.entries);
+			if (!options.equations) return;
+
+			_equation_memo.resize(_equations.size());
+			for (size_t i = 0, n = _equations.size(); i < n; ++i) {
+				if (call_count(_equations[i].program()) >= options.min_calls)
+					_equation_memo[i].emplace(_equations[i].used_slots(), 1, options.equation_entries);
+			}
+		}
+
+		// hits and misses of whole system
+		[[nodiscard]] memo_stats memo_statistics() const { return _memo ? _memo->stats() : memo_stats{}; }
+
+		// hits and misses of all memoized equations together
+		[[nodiscard]] memo_stats equation_memo_statistics() const {
+			memo_stats total;
+			for (const auto& memo : _equation_memo) {
+				if (memo) total += memo->stats();
+			}
+			return total;
+		}
+
+		// outputs which changed in last recompute()
+		[[nodiscard]] std::span<const size_t> changed() const { return _changed; }
+
+		// values of all equations as of last evaluation or recompute
+		[[nodiscard]] std::span<const num_t> values() const { return { _values.data() + _n_inputs, _n_equations }; }
+
+		// value of input or equation after last evaluation
+		[[nodiscard]] std::variant<num_t, error> value(const std::string& name) const {
+			const auto it = _slots.find(name);
+			if (it == _slots.end()) return error::unknown_token;
+			return _values[it->second];
+		}
+	};
+}
@@ -24,6 +24,7 @@ namespace defs {
 		{ error::unknown_token, "unknown token" },
 		{ error::wrong_args_count, "wrong number of arguments passed to function" },
 		{ error::bad_operator, "bad operator" },
+		{ error::bad_number, "bad number" },
 		{ error::out_of_range, "index is out of range" },
 		{ error::wrong_type, "type of variable is wrong" },
 		{ error::graph_cycle, "equation graph contains cycle" },
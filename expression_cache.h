@@ -0,0 +1,106 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <variant>
+#include <memory>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include "tokenizer.h"
+#include "compiled_expression.h"
+#include "arena.h"
+
+namespace solver
+{
+	// bounded cache of compiled expressions keyed by tokenizer::normalize of their text, safe to use from many threads.
+	// hits take shared lock only. full cache evicts by CLOCK: entry used since hand passed it last time gets second chance.
+	// expressions are shared, so evicted one stays valid for whoever still holds it
+	class expression_cache
+	{
+		struct entry {
+			std::string key;
+			std::shared_ptr<const compiled_expression> value;
+			std::atomic<bool> referenced{ false };
+		};
+
+		tokenizer _parser;
+		compile_options _options;
+		size_t _capacity;
+		std::unique_ptr<entry[]> _entries;
+		size_t _size{ 0 };
+		size_t _hand{ 0 };
+		std::unordered_map<std::string_view, size_t> _index; // views keys of _entries
+		mutable std::shared_mutex _mtx;
+		std::atomic<size_t> _hits{ 0 };
+		std::atomic<size_t> _misses{ 0 };
+
+		// entry to be reused, called under unique lock
+		size_t victim() {
+			if (_size < _capacity) return _size++;
+			while (_entries[_hand].referenced.exchange(false, std::memory_order_relaxed))
+				_hand = (_hand + 1) % _capacity;
+			const size_t slot = _hand;
+			_hand = (_hand + 1) % _capacity;
+			_index.erase(_entries[slot].key);
+			return slot;
+		}
+
+	public:
+		// expressions are parsed by parser and compiled with options, slots in order of first appearance of variables
+		explicit expression_cache(tokenizer parser, const size_t capacity = 1024, const compile_options& options = {}) :
+			_parser(std::move(parser)), _options(options), _capacity(std::max<size_t>(capacity, 1)),
+			_entries(std::make_unique<entry[]>(_capacity)) {
+			_index.reserve(_capacity);
+		}
+
+		// compiled expression of text, compiled on first request. errors are not cached
+		[[nodiscard]] std::variant<std::shared_ptr<const compiled_expression>, error> get(const std::string_view text) {
+			thread_local std::string key;
+			_parser.normalize(text, key);
+			{
+				std::shared_lock lk(_mtx);
+				if (const auto it = _index.find(key); it != _index.end()) {
+					entry& e = _entries[it->second];
+					e.referenced.store(true, std::memory_order_relaxed);
+					_hits.fetch_add(1, std::memory_order_relaxed);
+					return e.value;
+				}
+			}
+			_misses.fetch_add(1, std::memory_order_relaxed);
+
+			// compiled without lock, normalized text so result does not depend on which spelling came first
+			thread_local arena scratch;
+			scratch.reset();
+			const auto postfix = _parser.parse_postfix(key, scratch.resource());
+			if (postfix.index() == 1) return std::get<error>(postfix);
+			auto ce = compiled_expression::compile(std::get<0>(postfix), _options, scratch.resource());
+			if (ce.index() == 1) return std::get<error>(ce);
+			auto compiled = std::make_shared<const compiled_expression>(std::move(std::get<0>(ce)));
+
+			std::unique_lock lk(_mtx);
+			// other thread may have compiled it meanwhile
+			if (const auto it = _index.find(key); it != _index.end())
+				return _entries[it->second].value;
+			const size_t slot = victim();
+			entry& e = _entries[slot];
+			e.key = key;
+			e.value = compiled;
+			e.referenced.store(false, std::memory_order_relaxed);
+			_index.emplace(e.key, slot);
+			return compiled;
+		}
+
+		[[nodiscard]] size_t capacity() const { return _capacity; }
+
+		[[nodiscard]] size_t size() const {
+			std::shared_lock lk(_mtx);
+			return _size;
+		}
+
+		[[nodiscard]] size_t hits() const { return _hits.load(std::memory_order_relaxed); }
+		[[nodiscard]] size_t misses() const { return _misses.load(std::memory_order_relaxed); }
+	};
+}
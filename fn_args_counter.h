@@ -50,10 +50,11 @@ namespace fn_args_counter {
 		for (size_t idx = 0, n = v.size(); idx < n; ++idx) {
 			if (!m.contains(idx)) continue;
 			if (v[idx].lex_type == defs::lex::function) {
-				const auto& fn_name = std::get<std::string>(v[idx].data);
-				if (!defs::is_multi_arg_funcs(fn_name)) {
-					auto fn = defs::func_map.at(fn_name);
-					if (m.at(idx) != defs::term_args_map.at(fn.index()))
+				const auto& fn_name = v[idx].name();
+				// functions without action, like int, are left to type check
+				const auto fn = defs::func_map.find(fn_name);
+				if (!defs::is_multi_arg_funcs(fn_name) && fn != defs::func_map.end()) {
+					if (m.at(idx) != defs::term_args.at(fn->second.index()))
 						return defs::error::wrong_args_count;
 				}
 			}
@@ -0,0 +1,52 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <optional>
+
+// replacements of global allocation functions counting every call, nothrow and array forms forward to these.
+// kept apart from code using the counter so allocation and release stay opaque to optimizer there.
+// they cost every allocation of the process an atomic increment, so only benchmark builds define BENCH_COUNT_ALLOCATIONS
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+namespace
+{
+	std::atomic<size_t> n_allocations{ 0 };
+}
+
+void* operator new(const size_t size) {
+	n_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// over-aligned blocks (pmr resources ask for these) keep pointer to malloc'ed block right before them
+void* operator new(const size_t size, const std::align_val_t align) {
+	const size_t a = std::max(static_cast<size_t>(align), 2 * sizeof(void*));
+	void* const raw = operator new(size + a);
+	void* const p = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(raw) + a) & ~(uintptr_t{ a } - 1));
+	static_cast<void**>(p)[-1] = raw;
+	return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+	if (p) operator delete(static_cast<void**>(p)[-1]);
+}
+void operator delete(void* p, size_t, const std::align_val_t align) noexcept { operator delete(p, align); }
+
+namespace bench
+{
+	std::optional<size_t> heap_allocations() { return n_allocations.load(std::memory_order_relaxed); }
+}
+#else
+namespace bench
+{
+	std::optional<size_t> heap_allocations() { return std::nullopt; }
+}
+#endif
@@ -0,0 +1,360 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <bit>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SOLVER_JIT_X64 1
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#include "vm.h"
+
+namespace solver::jit
+{
+	// machine code of one vm program: void f(const num_t* v, num_t* n, bool_t* b), same effect as vm::execute
+	using entry_t = void(*)(const num_t*, num_t*, bool_t*);
+
+	// executable memory holding generated code, released on destruction
+	class code {
+		void* _mem{ nullptr };
+		size_t _size{ 0 };
+
+	public:
+		explicit code(std::span<const uint8_t> bytes) {
+#if SOLVER_JIT_X64
+#if defined(_WIN32)
+			void* mem = VirtualAlloc(nullptr, bytes.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (!mem) return;
+			std::memcpy(mem, bytes.data(), bytes.size());
+			DWORD old;
+			if (!VirtualProtect(mem, bytes.size(), PAGE_EXECUTE_READ, &old)) {
+				VirtualFree(mem, 0, MEM_RELEASE);
+				return;
+			}
+			FlushInstructionCache(GetCurrentProcess(), mem, bytes.size());
+#else
+			void* mem = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED) return;
+			std::memcpy(mem, bytes.data(), bytes.size());
+			if (mprotect(mem, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+				munmap(mem, bytes.size());
+				return;
+			}
+#endif
+			_mem = mem;
+			_size = bytes.size();
+#else
+			(void)bytes;
+#endif
+		}
+
+		code(const code&) = delete;
+		code& operator=(const code&) = delete;
+
+		~code() {
+#if SOLVER_JIT_X64
+			if (!_mem) return;
+#if defined(_WIN32)
+			VirtualFree(_mem, 0, MEM_RELEASE);
+#else
+			munmap(_mem, _size);
+#endif
+#endif
+		}
+
+		[[nodiscard]] bool valid() const { return _mem != nullptr; }
+		[[nodiscard]] entry_t entry() const { return reinterpret_cast<entry_t>(_mem); }
+	};
+
+#if SOLVER_JIT_X64
+	// x86-64 encoder for the few instruction forms vm programs lower to.
+	// values stay in register file in memory: rbx = v, r12 = n, r13 = b, xmm0..xmm2 and rax, rcx are scratch.
+	// every vm instruction becomes a short sequence of SSE2 scalar instructions, calls go to function pointers directly
+	class assembler {
+		enum reg : uint8_t { rax = 0, rcx = 1, rbx = 3, r12 = 12, r13 = 13 };
+
+		std::vector<uint8_t> _bytes;
+		std::vector<size_t> _starts;                       // code offset of every vm instruction, plus end
+		std::vector<std::pair<size_t, uint32_t>> _fixups; // rel32 position and target vm instruction
+
+		void byte(const uint8_t b) { _bytes.push_back(b); }
+		void bytes(std::initializer_list<uint8_t> bs) { _bytes.insert(_bytes.end(), bs); }
+		void imm32(const uint32_t v) { for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+		void imm64(const uint64_t v) { for (int i = 0; i < 8; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+
+		// [prefix] [rex] opcode modrm(reg, [base + disp32])
+		void mem_op(const uint8_t prefix, const bool w, std::initializer_list<uint8_t> opcode, const uint8_t r, const reg base, const uint32_t disp) {
+			if (prefix) byte(prefix);
+			const uint8_t rex = static_cast<uint8_t>(0x40 | (w ? 8 : 0) | (r >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0));
+			if (rex != 0x40) byte(rex);
+			bytes(opcode);
+			byte(static_cast<uint8_t>(0x80 | ((r & 7) << 3) | (base & 7)));
+			if ((base & 7) == 4) byte(0x24); // sib for r12
+			imm32(disp);
+		}
+
+		static uint32_t num(const uint32_t i) { return i * static_cast<uint32_t>(sizeof(num_t)); }
+		static uint32_t boolean(const uint32_t i) { return i * static_cast<uint32_t>(sizeof(bool_t)); }
+
+		void load_sd(const uint8_t x, const reg base, const uint32_t disp) { mem_op(0xF2, false, { 0x0F, 0x10 }, x, base, disp); }
+		void store_sd(const uint8_t x, const reg base, const uint32_t disp) { mem_op(0xF2, false, { 0x0F, 0x11 }, x, base, disp); }
+		void arith_sd(const uint8_t op, const uint8_t x, const reg base, const uint32_t disp) { mem_op(0xF2, false, { 0x0F, op }, x, base, disp); }
+		void ucomisd(const uint8_t x, const reg base, const uint32_t disp) { mem_op(0x66, false, { 0x0F, 0x2E }, x, base, disp); }
+		void load_q(const reg r, const reg base, const uint32_t disp) { mem_op(0, true, { 0x8B }, r, base, disp); }
+		void store_q(const reg r, const reg base, const uint32_t disp) { mem_op(0, true, { 0x89 }, r, base, disp); }
+		void load_b(const reg base, const uint32_t disp) { mem_op(0, false, { 0x8A }, rax, base, disp); }  // mov al, m8
+		void store_b(const reg base, const uint32_t disp) { mem_op(0, false, { 0x88 }, rax, base, disp); } // mov m8, al
+		void test_b(const uint32_t disp) { mem_op(0, false, { 0x80 }, 7, r13, disp); byte(0); }           // cmp byte m8, 0
+
+		void mov_rax_imm(const uint64_t v) { bytes({ 0x48, 0xB8 }); imm64(v); }
+		void movq_xmm_rax(const uint8_t x) { bytes({ 0x66, 0x48, 0x0F, 0x6E, static_cast<uint8_t>(0xC0 | (x << 3)) }); }
+		void load_imm(const uint8_t x, const num_t v) {
+			mov_rax_imm(std::bit_cast<uint64_t>(v));
+			movq_xmm_rax(x);
+		}
+		void call(const void* f) {
+			mov_rax_imm(reinterpret_cast<uint64_t>(f));
+			bytes({ 0xFF, 0xD0 });
+		}
+		void cmov_rax_rcx(const uint8_t cc) { bytes({ 0x48, 0x0F, static_cast<uint8_t>(0x40 | cc), 0xC1 }); }
+		void jcc(const uint8_t cc, const uint32_t target) {
+			bytes({ 0x0F, static_cast<uint8_t>(0x80 | cc) });
+			_fixups.emplace_back(_bytes.size(), target);
+			imm32(0);
+		}
+		void jmp(const uint32_t target) {
+			byte(0xE9);
+			_fixups.emplace_back(_bytes.size(), target);
+			imm32(0);
+		}
+
+		// condition codes
+		static constexpr uint8_t cc_b = 0x2, cc_ae = 0x3, cc_e = 0x4, cc_ne = 0x5, cc_be = 0x6, cc_a = 0x7, cc_p = 0xA, cc_np = 0xB;
+
+		// flags of ordered comparison n[a] op n[b], returns condition true when comparison holds. unordered is false for all of them
+		uint8_t compare(const vm::op_code op, const uint32_t a, const uint32_t b) {
+			switch (op) {
+				case vm::op_code::lt: case vm::op_code::select_lt: case vm::op_code::jump_nlt:
+					load_sd(0, r12, num(b)); ucomisd(0, r12, num(a)); return cc_a;  // b > a
+				case vm::op_code::le: case vm::op_code::select_le: case vm::op_code::jump_nle:
+					load_sd(0, r12, num(b)); ucomisd(0, r12, num(a)); return cc_ae; // b >= a
+				case vm::op_code::gt: case vm::op_code::select_gt: case vm::op_code::jump_ngt:
+					load_sd(0, r12, num(a)); ucomisd(0, r12, num(b)); return cc_a;
+				default:
+					load_sd(0, r12, num(a)); ucomisd(0, r12, num(b)); return cc_ae;
+			}
+		}
+
+		static num_t fma_f(const num_t a, const num_t b, const num_t c) { return std::fma(a, b, c); }
+
+		void emit(const vm::instruction& i) {
+			using vm::op_code;
+			switch (i.code) {
+				case op_code::ld_const:
+					mov_rax_imm(std::bit_cast<uint64_t>(i.imm));
+					store_q(rax, r12, num(i.dst));
+					break;
+				case op_code::ld_var:
+					load_q(rax, rbx, num(i.a));
+					store_q(rax, r12, num(i.dst));
+					break;
+				case op_code::ld_bool:
+					mem_op(0, false, { 0xC6 }, 0, r13, boolean(i.dst));
+					byte(i.imm != num_t{ 0 } ? 1 : 0);
+					break;
+				case op_code::neg:
+					load_q(rax, r12, num(i.a));
+					bytes({ 0x48, 0x0F, 0xBA, 0xF8, 0x3F }); // btc rax, 63
+					store_q(rax, r12, num(i.dst));
+					break;
+				case op_code::add: case op_code::sub: case op_code::mul: case op_code::div: {
+					const uint8_t op = i.code == op_code::add ? 0x58 : i.code == op_code::sub ? 0x5C : i.code == op_code::mul ? 0x59 : 0x5E;
+					load_sd(0, r12, num(i.a));
+					arith_sd(op, 0, r12, num(i.b));
+					store_sd(0, r12, num(i.dst));
+					break;
+				}
+				case op_code::add_rc: case op_code::sub_rc: case op_code::mul_rc: case op_code::div_rc:
+				case op_code::add_vc: case op_code::sub_vc: case op_code::mul_vc: case op_code::div_vc: {
+					const bool var = i.code >= op_code::add_vc;
+					const op_code base = var ? static_cast<op_code>(static_cast<int>(i.code) - static_cast<int>(op_code::add_vc) + static_cast<int>(op_code::add_rc)) : i.code;
+					const uint8_t op = base == op_code::add_rc ? 0x58 : base == op_code::sub_rc ? 0x5C : base == op_code::mul_rc ? 0x59 : 0x5E;
+					load_imm(1, i.imm);
+					load_sd(0, var ? rbx : r12, num(i.a));
+					bytes({ 0xF2, 0x0F, op, 0xC1 }); // op xmm0, xmm1
+					store_sd(0, r12, num(i.dst));
+					break;
+				}
+				case op_code::sub_cr: case op_code::div_cr: case op_code::sub_cv: case op_code::div_cv: {
+					const bool var = i.code == op_code::sub_cv || i.code == op_code::div_cv;
+					const bool sub = i.code == op_code::sub_cr || i.code == op_code::sub_cv;
+					load_imm(0, i.imm);
+					arith_sd(sub ? 0x5C : 0x5E, 0, var ? rbx : r12, num(i.a));
+					store_sd(0, r12, num(i.dst));
+					break;
+				}
+				case op_code::fma:
+					load_sd(0, r12, num(i.a));
+					load_sd(1, r12, num(i.b));
+					load_sd(2, r12, num(i.c));
+					call(reinterpret_cast<const void*>(&fma_f));
+					store_sd(0, r12, num(i.dst));
+					break;
+				case op_code::sqrt:
+					// sqrtsd alone differs from pow at -0 and -inf
+					load_sd(0, r12, num(i.a));
+					call(reinterpret_cast<const void*>(&vm::half_power));
+					store_sd(0, r12, num(i.dst));
+					break;
+				case op_code::min: case op_code::max:
+					// minsd/maxsd return second operand when unordered or equal, same as vm
+					load_sd(0, r12, num(i.b));
+					arith_sd(i.code == op_code::min ? 0x5D : 0x5F, 0, r12, num(i.a));
+					store_sd(0, r12, num(i.dst));
+					break;
+				case op_code::call0:
+					call(reinterpret_cast<const void*>(i.fn.f0));
+					store_sd(0, r12, num(i.dst));
+					break;
+				case op_code::call1: case op_code::call1_v:
+					load_sd(0, i.code == op_code::call1 ? r12 : rbx, num(i.a));
+					call(reinterpret_cast<const void*>(i.fn.f1));
+					store_sd(0, r12, num(i.dst));
+					break;
+				case op_code::call2:
+					load_sd(0, r12, num(i.a));
+					load_sd(1, r12, num(i.b));
+					call(reinterpret_cast<const void*>(i.fn.f2));
+					store_sd(0, r12, num(i.dst));
+					break;
+				case op_code::lt: case op_code::le: case op_code::gt: case op_code::ge: {
+					const uint8_t cc = compare(i.code, i.a, i.b);
+					bytes({ 0x0F, static_cast<uint8_t>(0x90 | cc), 0xC0 }); // setcc al
+					store_b(r13, boolean(i.dst));
+					break;
+				}
+				case op_code::eq:
+					load_sd(0, r12, num(i.a));
+					ucomisd(0, r12, num(i.b));
+					bytes({ 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8 }); // sete al; setnp cl; and al, cl
+					store_b(r13, boolean(i.dst));
+					break;
+				case op_code::logic_and: case op_code::logic_or: case op_code::logic_xor: {
+					const uint8_t op = i.code == op_code::logic_and ? 0x22 : i.code == op_code::logic_or ? 0x0A : 0x32;
+					load_b(r13, boolean(i.a));
+					mem_op(0, false, { op }, rax, r13, boolean(i.b)); // op al, m8
+					store_b(r13, boolean(i.dst));
+					break;
+				}
+				case op_code::select:
+					load_q(rax, r12, num(i.b));
+					load_q(rcx, r12, num(i.c));
+					test_b(boolean(i.a));
+					cmov_rax_rcx(cc_e);
+					store_q(rax, r12, num(i.dst));
+					break;
+				case op_code::select_lt: case op_code::select_le: case op_code::select_gt: case op_code::select_ge: {
+					load_q(rax, r12, num(i.c));
+					load_q(rcx, r12, num(i.e));
+					const uint8_t cc = compare(i.code, i.a, i.b);
+					cmov_rax_rcx(cc ^ 1); // negated condition picks e
+					store_q(rax, r12, num(i.dst));
+					break;
+				}
+				case op_code::select_eq:
+					load_q(rax, r12, num(i.c));
+					load_q(rcx, r12, num(i.e));
+					load_sd(0, r12, num(i.a));
+					ucomisd(0, r12, num(i.b));
+					cmov_rax_rcx(cc_ne);
+					cmov_rax_rcx(cc_p);
+					store_q(rax, r12, num(i.dst));
+					break;
+				case op_code::mov:
+					load_q(rax, r12, num(i.a));
+					store_q(rax, r12, num(i.dst));
+					break;
+				case op_code::bmov:
+					load_b(r13, boolean(i.a));
+					store_b(r13, boolean(i.dst));
+					break;
+				case op_code::jump:
+					jmp(i.c);
+					break;
+				case op_code::jump_if: case op_code::jump_unless:
+					test_b(boolean(i.a));
+					jcc(i.code == op_code::jump_if ? cc_ne : cc_e, i.c);
+					break;
+				case op_code::jump_nlt: case op_code::jump_nle: case op_code::jump_ngt: case op_code::jump_nge:
+					jcc(compare(i.code, i.a, i.b) ^ 1, i.c);
+					break;
+				case op_code::jump_neq:
+					load_sd(0, r12, num(i.a));
+					ucomisd(0, r12, num(i.b));
+					jcc(cc_ne, i.c);
+					jcc(cc_p, i.c);
+					break;
+			}
+		}
+
+	public:
+		std::vector<uint8_t> assemble(std::span<const vm::instruction> program) {
+			// prologue: keep arguments in callee saved registers, 32 bytes of shadow space keep stack aligned for calls
+			bytes({ 0x53, 0x41, 0x54, 0x41, 0x55 }); // push rbx; push r12; push r13
+#if defined(_WIN32)
+			bytes({ 0x48, 0x89, 0xCB, 0x49, 0x89, 0xD4, 0x4D, 0x89, 0xC5 }); // mov rbx, rcx; mov r12, rdx; mov r13, r8
+#else
+			bytes({ 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xD5 }); // mov rbx, rdi; mov r12, rsi; mov r13, rdx
+#endif
+			bytes({ 0x48, 0x83, 0xEC, 0x20 }); // sub rsp, 32
+
+			for (const auto& i : program) {
+				_starts.push_back(_bytes.size());
+				emit(i);
+			}
+			_starts.push_back(_bytes.size());
+
+			bytes({ 0x48, 0x83, 0xC4, 0x20, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 }); // add rsp, 32; pop r13; pop r12; pop rbx; ret
+
+			for (const auto& [pos, target] : _fixups) {
+				const int64_t rel = static_cast<int64_t>(_starts[target]) - static_cast<int64_t>(pos + 4);
+				const auto r = static_cast<uint32_t>(static_cast<int32_t>(rel));
+				for (int k = 0; k < 4; ++k) _bytes[pos + k] = static_cast<uint8_t>(r >> (8 * k));
+			}
+			return std::move(_bytes);
+		}
+	};
+#endif
+
+	// true when programs can be compiled to native code on this platform
+	[[nodiscard]] constexpr bool available() {
+#if SOLVER_JIT_X64
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	// native code for program, nullptr when jit is not available so caller falls back to vm::execute
+	[[nodiscard]] inline std::shared_ptr<const code> compile(std::span<const vm::instruction> program) {
+#if SOLVER_JIT_X64
+		auto c = std::make_shared<const code>(assembler{}.assemble(program));
+		if (c->valid()) return c;
+#else
+		(void)program;
+#endif
+		return nullptr;
+	}
+}
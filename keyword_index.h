@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#include "maps.h"
+
+namespace defs
+{
+	// names compare equal ignoring case of ascii letters, like classify always did
+	[[nodiscard]] constexpr char fold_case(const char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+	struct ci_hash {
+		using is_transparent = void;
+		[[nodiscard]] size_t operator()(const std::string_view s) const noexcept {
+			uint64_t h = 14695981039346656037ull; // fnv-1a
+			for (const char c : s) {
+				h ^= static_cast<unsigned char>(fold_case(c));
+				h *= 1099511628211ull;
+			}
+			return static_cast<size_t>(h);
+		}
+	};
+
+	struct ci_equal {
+		using is_transparent = void;
+		[[nodiscard]] bool operator()(const std::string_view a, const std::string_view b) const noexcept {
+			return std::ranges::equal(a, b, [](const char x, const char y) { return fold_case(x) == fold_case(y); });
+		}
+	};
+
+	// case-insensitive hash index of names to their position, O(length of name) per lookup.
+	// of names equal up to case the first one added wins
+	class name_index {
+		std::unordered_map<std::string, size_t, ci_hash, ci_equal> _index;
+	public:
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		name_index() = default;
+		explicit name_index(const std::vector<std::string>& names) {
+			_index.reserve(names.size());
+			for (size_t i = 0; i < names.size(); ++i)
+				_index.emplace(names[i], i);
+		}
+
+		[[nodiscard]] size_t find(const std::string_view name) const {
+			const auto it = _index.find(name);
+			return it == _index.end() ? npos : it->second;
+		}
+	};
+
+	// names of operators, functions and constants, fixed once built and shared by all tokenizers
+	inline static const symbol_table builtin_symbols = [] {
+		symbol_table table;
+		for (const std::string& name : lex_operators::names) (void)table.intern(name);
+		for (const std::string& name : lex_functions::names) (void)table.intern(name);
+		for (const std::string& name : lex_consts::names) (void)table.intern(name);
+		return table;
+	}();
+
+	struct operator_entry {
+		const std::string* name;
+		const std::vector<lex>* lexes; // candidates in lex_oper_map order
+		symbol sym;
+	};
+
+	// operators dispatched by their first char, longer ones first so <= is matched before <
+	class operator_table {
+		std::array<std::vector<operator_entry>, 256> _by_first;
+	public:
+		operator_table() {
+			for (const std::string& name : lex_operators::names) // already sorted by length
+				_by_first[static_cast<unsigned char>(name[0])].push_back({ &name, &lex_oper_map.at(name), builtin_symbols.find(name) });
+		}
+
+		[[nodiscard]] const operator_entry* match(const std::string_view rest) const {
+			for (const operator_entry& e : _by_first[static_cast<unsigned char>(rest[0])]) {
+				if (rest.starts_with(*e.name)) return &e;
+			}
+			return nullptr;
+		}
+	};
+
+	inline static const operator_table operator_dispatch;
+	inline static const name_index function_index{ lex_functions::names };
+	inline static const std::vector<symbol> function_symbols = [] {
+		std::vector<symbol> syms;
+		for (const std::string& name : lex_functions::names) syms.push_back(builtin_symbols.find(name));
+		return syms;
+	}();
+	inline static const std::vector<symbol> constant_symbols = [] {
+		std::vector<symbol> syms;
+		for (const std::string& name : lex_consts::names) syms.push_back(builtin_symbols.find(name));
+		return syms;
+	}();
+
+	// arguments expected by function_symbols[i], 0 when any count is allowed or left to type check
+	inline static const std::vector<size_t> function_arities = [] {
+		std::vector<size_t> arities;
+		for (const std::string& name : lex_functions::names) {
+			const auto it = func_map.find(name);
+			arities.push_back(is_multi_arg_funcs(name) || it == func_map.end() ? 0 : term_args.at(it->second.index()));
+		}
+		return arities;
+	}();
+
+	[[nodiscard]] inline size_t function_arity(const symbol fn) {
+		for (size_t i = 0; i < function_symbols.size(); ++i) {
+			if (function_symbols[i] == fn) return function_arities[i];
+		}
+		return 0;
+	}
+}
@@ -9,10 +9,16 @@
 #include <iostream>
 
 #include "tokenizer.h"
-#include "shunting_yard.h"
+#include "equation_system.h"
+#include "expression_cache.h"
+#include "benchmark.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+	// EquationSolver --bench [name]
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+		return bench::run(argc > 2 ? argv[2] : "");
+
 	std::string eq { "2+3*4^2" };
 	eq = "log(+82.3)+7^sin(+3.9^2)";
 	//eq = "Min(33, 4)";
@@ -26,32 +32,37 @@ int main()
 	std::vector<std::string> c_names;
 	std::ranges::transform(vars, std::back_inserter(c_names), [](const auto& it) { return it.first; });
 	const solver::tokenizer parser{ c_names, equations };
-	std::variant<std::vector<std::string>, error> parse_result = parser.parse();
-	if (parse_result.index() == 1) {
-		const error err = std::get<1>(parse_result);
+	auto sys = solver::equation_system::compile(parser);
+	if (sys.index() == 1) {
+		const error err = std::get<1>(sys);
 		const std::string s_err = error_str[err];
 		printf("Cannot parse: %s due to %s error\n\n", eq.c_str(), s_err.c_str());
 	}
+	else if (const auto values = std::get<0>(sys).evaluate(vars); values.index() == 0) {
+		const auto names = std::get<0>(sys).names();
+		for (size_t i = 0; i < names.size(); ++i)
+			printf("%s = %f\n", names[i].c_str(), std::get<0>(values)[i]);
+		printf("\n");
+	}
 
+	// repeated expressions are not compiled again
+	solver::expression_cache cache{ solver::tokenizer{ c_names, {} } };
 	while (!eq.empty()) {
 		std::getline(std::cin, eq);
 		if (eq == "q") break;
 
-		const solver::tokenizer parser1;
-		std::vector<defs::lex_wrapper> vec_lex = parser1.parseSingle(eq);
-		if (vec_lex.empty() || vec_lex.back().lex_type == lex::error) {
-			const error err = vec_lex.back().data.index() == 4 ? std::get<4>(vec_lex.back().data) : error::unknown;
+		const auto compiled = cache.get(eq);
+		if (compiled.index() == 1) {
+			const error err = std::get<error>(compiled);
 			const std::string s_err = error_str[err];
 			printf("Cannot parse: %s due to %s error\n\n", eq.c_str(), s_err.c_str());
 			continue;
 		}
 
-		// remove end
-		vec_lex.erase(--vec_lex.end());
-
-		// run shunting yard algorithm
-		const auto algo = solver::shunting_yard { vec_lex, vars };
-		if (const auto res = algo.solve(); res.index() == 0) {
+		const auto& ce = *std::get<0>(compiled);
+		const auto values = ce.bind(vars);
+		const auto res = values.index() == 0 ? ce.evaluate(std::get<0>(values)) : std::get<error>(values);
+		if (res.index() == 0) {
 			cnum_t d = std::get<num_t>(res);
 			printf("%s = %f\n\n", eq.c_str(), d);
 		}
@@ -1,65 +1,81 @@
 #pragma once
 #include <map>
+#include <algorithm>
 #include <utility>
 #include <vector>
 #include <string>
 #include <array>
 #include <variant>
+#include <string_view>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
 
 #include "errors.h"
 #include "operators.h"
+#include "symbol_table.h"
 
 namespace defs
 {
-  // lex --> #args, precedence, associativity
-  inline static std::map<lex, std::tuple<int, int, associativity>> op_props {
-    { lex::plus,        { 2, 3, associativity::left } },
-    { lex::minus,       { 2, 3, associativity::left } },
-    { lex::unary_minus, { 2, 3, associativity::left } },
-    { lex::multiply,    { 2, 4, associativity::left } },
-    { lex::divide,      { 2, 4, associativity::left } },
-    { lex::logic_or,    { 2, 1, associativity::left } },
-    { lex::logic_and,	  { 2, 1, associativity::left } },
-    { lex::logic_xor,	  { 2, 1, associativity::left } },
-    { lex::less,        { 2, 2, associativity::left } },
-    { lex::less_equal,	{ 2, 2, associativity::left } },
-    { lex::more,        { 2, 2, associativity::left } },
-    { lex::more_equal,  { 2, 2, associativity::left } },
-    { lex::equal,       { 2, 2, associativity::left } },
-    { lex::power,       { 2, 5, associativity::right } }
-	};
-
-  // value is a list of lexes that can happen before key
-  inline static const std::map<lex, std::vector<lex>> lex_order {
-    { lex::begin,       { } },
-    { lex::lb,          { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::function, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor } },
-    { lex::rb,          { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::comma,       { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::plus,        { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::unary_plus,  { lex::begin, lex::lb, lex::comma, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_and, lex::logic_or, lex::logic_xor } },
-    { lex::minus,       { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::unary_minus, { lex::begin, lex::lb, lex::comma, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_and, lex::logic_or, lex::logic_xor } },
-    { lex::multiply,    { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::divide,      { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::power,       { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::less,        { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::less_equal,  { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::more,        { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::more_equal,  { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::equal,       { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::logic_or,    { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::logic_and,   { lex::rb, lex::number, lex::variable, lex::constant } },
-    { lex::number,      { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor } },
-    { lex::constant,	  { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor } },
-    { lex::variable,    { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor } },
-    { lex::function,    { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor } },
-    { lex::space,       { lex::begin, lex::lb, lex::rb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::not_equal, lex::logic_or, lex::logic_and, lex::logic_xor, lex::number, lex::constant, lex::boolean, lex::variable, lex::function } },
-    { lex::end,         { lex::rb, lex::number, lex::variable, lex::constant } }
-  };
+  // lex --> #args, precedence, associativity; lexes which are not operators have precedence 0.
+  // flat so hot loop of parser and constexpr parser of static_expression.h read the same table
+  struct op_info { int n_args{ 0 }; int precedence{ 0 }; associativity assoc{ associativity::left }; };
+  inline constexpr auto op_props = [] {
+    std::array<op_info, n_lexes> t{};
+    const auto set = [&t](const lex l, const op_info props) { t[static_cast<size_t>(l)] = props; };
+    set(lex::plus,        { 2, 3, associativity::left });
+    set(lex::minus,       { 2, 3, associativity::left });
+    set(lex::unary_minus, { 2, 3, associativity::left });
+    set(lex::multiply,    { 2, 4, associativity::left });
+    set(lex::divide,      { 2, 4, associativity::left });
+    set(lex::logic_or,    { 2, 1, associativity::left });
+    set(lex::logic_and,   { 2, 1, associativity::left });
+    set(lex::logic_xor,   { 2, 1, associativity::left });
+    set(lex::less,        { 2, 2, associativity::left });
+    set(lex::less_equal,  { 2, 2, associativity::left });
+    set(lex::more,        { 2, 2, associativity::left });
+    set(lex::more_equal,  { 2, 2, associativity::left });
+    set(lex::equal,       { 2, 2, associativity::left });
+    set(lex::power,       { 2, 5, associativity::right });
+    return t;
+  }();
+
+  constexpr const op_info& op_prop(const lex l) { return op_props[static_cast<size_t>(l)]; }
+
+  // lex_follow[curr] has bit prev set when prev can happen before curr, so grammar check is one shift and mask
+  inline constexpr auto lex_follow = [] {
+    std::array<uint32_t, n_lexes> t{};
+    const auto allow = [&t](const lex curr, const std::initializer_list<lex> prev) {
+      for (const lex p : prev) t[static_cast<size_t>(curr)] |= uint32_t{ 1 } << static_cast<size_t>(p);
+    };
+    allow(lex::lb,          { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::function, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor });
+    allow(lex::rb,          { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::comma,       { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::plus,        { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::unary_plus,  { lex::begin, lex::lb, lex::comma, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_and, lex::logic_or, lex::logic_xor });
+    allow(lex::minus,       { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::unary_minus, { lex::begin, lex::lb, lex::comma, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_and, lex::logic_or, lex::logic_xor });
+    allow(lex::multiply,    { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::divide,      { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::power,       { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::less,        { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::less_equal,  { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::more,        { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::more_equal,  { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::equal,       { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::logic_or,    { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::logic_and,   { lex::rb, lex::number, lex::variable, lex::constant });
+    allow(lex::number,      { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor });
+    allow(lex::constant,    { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor });
+    allow(lex::variable,    { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor });
+    allow(lex::function,    { lex::begin, lex::lb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::logic_or, lex::logic_and, lex::logic_xor });
+    allow(lex::space,       { lex::begin, lex::lb, lex::rb, lex::comma, lex::plus, lex::unary_plus, lex::minus, lex::unary_minus, lex::multiply, lex::divide, lex::power, lex::less, lex::less_equal, lex::more, lex::more_equal, lex::equal, lex::not_equal, lex::logic_or, lex::logic_and, lex::logic_xor, lex::number, lex::constant, lex::boolean, lex::variable, lex::function });
+    allow(lex::end,         { lex::rb, lex::number, lex::variable, lex::constant });
+    return t;
+  }();
 
-  bool static can_follow(const lex prev, const lex curr) {
-    const auto& order = lex_order.at(curr);
-    return std::ranges::find(order, prev) != end(order) ? true : false;
+  constexpr bool can_follow(const lex prev, const lex curr) {
+    return (lex_follow[static_cast<size_t>(curr)] >> static_cast<size_t>(prev) & 1) != 0;
   }
 
   class lex_operators {
@@ -108,37 +124,38 @@ namespace defs
   //////////////////////////////// function as a special case of operator ///////////////////////////////////
   class lex_functions {
   public:
-    inline static const std::string sin = "sin";
-    inline static const std::string cos = "cos";
-    inline static const std::string tan = "tan";
-    inline static const std::string abs = "abs";
-    inline static const std::string sign = "sign";
-    inline static const std::string ctn = "ctn";
-    inline static const std::string atan = "atan";
-    inline static const std::string atan2 = "atan2";
-    inline static const std::string min = "min";
-    inline static const std::string max = "max";
-    inline static const std::string iff = "if";
-    inline static const std::string intt = "int";
-    inline static const std::string floor = "floor";
-    inline static const std::string ceil = "ceil";
-    inline static const std::string round = "round";
-    inline static const std::string log = "log";
-    inline static const std::string log10 = "log10";
-    inline static const std::string ln = "ln";
-    inline static const std::string pow = "pow";
-    inline static const std::string exp = "exp";
+    inline static constexpr std::string_view sin = "sin";
+    inline static constexpr std::string_view cos = "cos";
+    inline static constexpr std::string_view tan = "tan";
+    inline static constexpr std::string_view abs = "abs";
+    inline static constexpr std::string_view sign = "sign";
+    inline static constexpr std::string_view ctn = "ctn";
+    inline static constexpr std::string_view atan = "atan";
+    inline static constexpr std::string_view atan2 = "atan2";
+    inline static constexpr std::string_view min = "min";
+    inline static constexpr std::string_view max = "max";
+    inline static constexpr std::string_view iff = "if";
+    inline static constexpr std::string_view intt = "int";
+    inline static constexpr std::string_view floor = "floor";
+    inline static constexpr std::string_view ceil = "ceil";
+    inline static constexpr std::string_view round = "round";
+    inline static constexpr std::string_view log = "log";
+    inline static constexpr std::string_view log10 = "log10";
+    inline static constexpr std::string_view ln = "ln";
+    inline static constexpr std::string_view pow = "pow";
+    inline static constexpr std::string_view exp = "exp";
   
-    inline static const std::vector<std::string> names {
-      sin, cos, tan, abs, sign, ctn, atan2, atan, min, max, iff, intt, floor, ceil, round, log10, log, ln, exp
-    };
+    inline static const std::vector<std::string> names = [] {
+      constexpr std::string_view all[] { sin, cos, tan, abs, sign, ctn, atan2, atan, min, max, iff, intt, floor, ceil, round, log10, log, ln, exp };
+      return std::vector<std::string>(std::begin(all), std::end(all));
+    }();
   };
 
   // consts as a special case of functions
   class lex_consts {
   public:
-    inline static const std::string pi = "pi";
-    inline static const std::vector<std::string> names { pi };
+    inline static constexpr std::string_view pi = "pi";
+    inline static const std::vector<std::string> names { std::string{ pi } };
   };
 
   // typedef std::variant<double, bool, op_general<double, double>, op_general<double, double, double>, op_general<double, bool, double, double>,
@@ -147,12 +164,18 @@ namespace defs
   typedef std::variant<num_t, bool_t, num_1num_t, num_2num_t, num_1bool_2num_t, bool_2num_t, bool_2bool_t, num_empty_t> Term;
 
   // index of variable in Term to # of arguments
-  inline static const std::map<size_t, size_t> term_args_map {
-    { 2, 1 }, { 3, 2 }, { 4, 3 }, { 5, 2 }, { 6, 2 }, { 7, 0 }
+  inline constexpr std::array<size_t, std::variant_size_v<Term>> term_args { 0, 0, 1, 2, 3, 2, 2, 0 };
+
+  constexpr bool is_multi_arg_funcs(const std::string_view fn) { return fn == lex_functions::min || fn == lex_functions::max; }
+
+  struct function_def {
+    std::string_view name;
+    Term action;
   };
 
-  // map of function to action
-  inline static const std::map<const std::string, Term> func_map {
+  // function --> action, # of arguments is term_args of action unless is_multi_arg_funcs.
+  // func_map and constexpr parser of static_expression.h are built from it
+  inline constexpr std::array<function_def, 18> function_defs { {
     { lex_functions::sin,   op_defs::sin_f },
     { lex_functions::cos,   op_defs::cos_f },
     { lex_functions::tan,   op_defs::tan_f },
@@ -171,7 +194,18 @@ namespace defs
     { lex_functions::exp,   op_defs::exp_f },
     { lex_functions::sign,  op_defs::sing_f },
     { lex_functions::abs,   op_defs::abs_f },
-  };
+  } };
+
+  inline constexpr std::array<function_def, 1> const_defs { {
+    { lex_consts::pi, op_defs::pi_f }
+  } };
+
+  // map of function to action
+  inline static const std::map<const std::string, Term> func_map = [] {
+    std::map<const std::string, Term> m;
+    for (const function_def& f : function_defs) m.emplace(f.name, f.action);
+    return m;
+  }();
 
   //// map of operator to action
   inline static const std::map<lex, Term> op_map {
@@ -191,31 +225,59 @@ namespace defs
     { lex::logic_xor,     op_defs::logic_xor_f }
   };
 
-  inline static const std::map<const std::string, Term> const_map {
-    { lex_consts::pi,    op_defs::pi_f }
-  };
+  inline static const std::map<const std::string, Term> const_map = [] {
+    std::map<const std::string, Term> m;
+    for (const function_def& c : const_defs) m.emplace(c.name, c.action);
+    return m;
+  }();
 
-  inline static const std::array<std::string, 2> multi_arg_funcs { lex_functions::min, lex_functions::max };
-
-  constexpr static bool is_multi_arg_funcs(const std::string& fn) { return fn == lex_functions::min || fn == lex_functions::max; }
+  inline constexpr std::array<std::string_view, 2> multi_arg_funcs { lex_functions::min, lex_functions::max };
   ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////////////
   //template<typename TNum, typename TBool>
+  // 16 bytes token: names of functions, variables, constants and operators are interned symbols,
+  // so tokens are copied without heap traffic. name stays valid as long as symbol_table it was interned to
   struct lex_wrapper {
+    enum class payload : uint8_t { none, number, boolean, name, error };
+
     lex_wrapper(lex l) : lex_type(l) {}
-    lex_wrapper(lex l, std::variant<std::monostate, num_t, bool_t, std::string, error> d) : lex_wrapper(l) {
-      data = std::move(d);
-    }
-    
+    lex_wrapper(lex l, const num_t d) : lex_type(l), kind(payload::number) { _number = d; }
+    lex_wrapper(lex l, const bool_t b) : lex_type(l), kind(payload::boolean) { _boolean = b; }
+    lex_wrapper(lex l, const symbol s) : lex_type(l), kind(payload::name) { _name = s; }
+    lex_wrapper(lex l, const error e) : lex_type(l), kind(payload::error) { _error = e; }
+
     bool operator==(const lex_wrapper& other) const {
-      return this->lex_type == other.lex_type && this->data == other.data;
+      if (lex_type != other.lex_type || kind != other.kind) return false;
+      switch (kind) {
+        case payload::number:  return _number == other._number;
+        case payload::boolean: return _boolean == other._boolean;
+        case payload::name:    return _name == other._name;
+        case payload::error:   return _error == other._error;
+        default:               return true;
+      }
     }
-    
+
+    [[nodiscard]] num_t number() const { return _number; }
+    [[nodiscard]] bool_t boolean() const { return _boolean; }
+    [[nodiscard]] symbol sym() const { return _name; }
+    [[nodiscard]] const std::string& name() const { return _name.str(); }
+    [[nodiscard]] bool has_name() const { return kind == payload::name; }
+    // error carried by token, unknown for tokens without one
+    [[nodiscard]] error err() const { return kind == payload::error ? _error : error::unknown; }
+
     lex lex_type;
-    std::variant<std::monostate, num_t, bool_t, std::string, error> data;
-    size_t n_args {0};
+    payload kind{ payload::none };
+    uint32_t n_args{ 0 };
+  private:
+    union {
+      num_t _number{ 0 };
+      bool_t _boolean;
+      symbol _name;
+      error _error;
+    };
   };
+  static_assert(sizeof(lex_wrapper) <= 16);
 
   inline static lex_wrapper lex_end_w { lex::end };
   inline static lex_wrapper lex_bad_tokens_seq_w { lex::error, error::bad_tokens_sequence };
@@ -0,0 +1,132 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <bit>
+#include <memory>
+#include <variant>
+#include <algorithm>
+#include <cstdint>
+
+#include "compiled_expression.h"
+
+namespace solver
+{
+	struct memo_options {
+		size_t entries{ 256 };         // results kept per table, rounded up to power of two. 0 turns memoization off
+		// equation_system only
+		bool equations{ false };       // memoize expensive equations (shared subexpressions too) on their own inputs
+		size_t equation_entries{ 16 }; // results kept per equation, small so tables of thousands of equations stay in cache
+		size_t min_calls{ 1 };         // equation is expensive when its program calls at least that many functions (sin, exp, pow, ...)
+	};
+
+	struct memo_stats {
+		size_t hits{ 0 };
+		size_t misses{ 0 };
+
+		[[nodiscard]] double hit_rate() const { return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses); }
+
+		memo_stats& operator+=(const memo_stats& other) {
+			hits += other.hits;
+			misses += other.misses;
+			return *this;
+		}
+	};
+
+	// direct mapped table of results keyed by exact bits of values at given slots: 0 and -0 are different keys,
+	// NaN matches only the same NaN. values of other slots do not matter.
+	// new result replaces older one of the same bucket. not thread safe
+	class memo_table
+	{
+		std::vector<size_t> _slots;
+		size_t _width;                // values per result
+		size_t _mask;
+		std::vector<uint64_t> _keys;  // _slots.size() per entry
+		std::vector<num_t> _results;  // _width per entry
+		std::vector<char> _used;
+		size_t _last{ 0 };            // bucket of last find
+		memo_stats _stats;
+
+		static uint64_t bits(const num_t v) { return std::bit_cast<uint64_t>(v); }
+
+	public:
+		memo_table(std::vector<size_t> slots, const size_t width, const size_t entries) :
+			_slots(std::move(slots)), _width(width), _mask(std::bit_ceil(std::max<size_t>(entries, 1)) - 1),
+			_keys((_mask + 1) * _slots.size()), _results((_mask + 1) * width), _used(_mask + 1, 0) {}
+
+		// result stored for values at slots, nullptr on miss
+		[[nodiscard]] const num_t* find(const num_t* values) {
+			uint64_t h = 0;
+			for (const size_t s : _slots)
+				h = (h ^ bits(values[s])) * 0x9E3779B97F4A7C15ull;
+			// low bits of products depend on low bits of doubles only, mostly 0 for round numbers
+			h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+			h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+			_last = static_cast<size_t>(h ^ (h >> 31)) & _mask;
+
+			if (_used[_last]) {
+				const uint64_t* key = &_keys[_last * _slots.size()];
+				bool same = true;
+				for (size_t k = 0, n = _slots.size(); k < n && same; ++k)
+					same = key[k] == bits(values[_slots[k]]);
+				if (same) {
+					++_stats.hits;
+					return &_results[_last * _width];
+				}
+			}
+			++_stats.misses;
+			return nullptr;
+		}
+
+		// keeps result of values which last find missed
+		void store(const num_t* values, const num_t* result) {
+			uint64_t* key = &_keys[_last * _slots.size()];
+			for (size_t k = 0, n = _slots.size(); k < n; ++k)
+				key[k] = bits(values[_slots[k]]);
+			std::copy_n(result, _width, &_results[_last * _width]);
+			_used[_last] = 1;
+		}
+
+		// forgets results, statistics are kept
+		void clear() { std::ranges::fill(_used, 0); }
+
+		[[nodiscard]] const memo_stats& stats() const { return _stats; }
+	};
+
+	// functions called by program, rough measure of how expensive its evaluation is
+	[[nodiscard]] inline size_t call_count(std::span<const vm::instruction> program) {
+		return static_cast<size_t>(std::ranges::count_if(program, [](const vm::instruction& ins) { return vm::is_call(ins.code); }));
+	}
+
+	// compiled expression evaluated through memo_table keyed by values of variables it reads.
+	// every operator and function is pure, so same values give same result. one per thread
+	class memoized_expression
+	{
+		std::shared_ptr<const compiled_expression> _expression;
+		memo_table _memo;
+		vm::registers _regs;
+
+	public:
+		explicit memoized_expression(std::shared_ptr<const compiled_expression> expression, const size_t entries = 256) :
+			_expression(std::move(expression)), _memo(_expression->used_slots(), 1, entries) {}
+
+		[[nodiscard]] std::variant<num_t, bool_t, error> evaluate(std::span<const num_t> vars) {
+			if (vars.size() < _expression->n_slots()) return error::out_of_range;
+
+			if (const num_t* hit = _memo.find(vars.data())) {
+				if (_expression->result_type() == value_type::num) return *hit;
+				return *hit != num_t{ 0 };
+			}
+			const auto res = _expression->evaluate(vars, _regs);
+			if (res.index() == 2) return res;
+			const num_t v = res.index() == 0 ? std::get<num_t>(res) : std::get<bool_t>(res) ? num_t{ 1 } : num_t{ 0 };
+			_memo.store(vars.data(), &v);
+			return res;
+		}
+
+		[[nodiscard]] const compiled_expression& expression() const { return *_expression; }
+
+		void clear() { _memo.clear(); }
+
+		[[nodiscard]] const memo_stats& stats() const { return _memo.stats(); }
+	};
+}
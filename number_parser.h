@@ -0,0 +1,288 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+#include "common_types.h"
+
+namespace defs
+{
+	namespace detail {
+		[[nodiscard]] constexpr bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+
+		// powers of 10 exactly representable by double
+		inline constexpr std::array<double, 23> exact_pow10 {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		// 8 ascii digits at p to their value in one multiply-shift sequence, false when any of them is not digit.
+		// compile time evaluation takes digits one by one instead
+		[[nodiscard]] constexpr bool eight_digits(const char* p, uint64_t& value) {
+			if (std::is_constant_evaluated()) return false;
+			if constexpr (std::endian::native != std::endian::little) return false;
+			uint64_t v;
+			std::memcpy(&v, p, sizeof(v));
+			if (((v & 0xF0F0F0F0F0F0F0F0) | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) != 0x3333333333333333)
+				return false;
+			v -= 0x3030303030303030;
+			v = v * 10 + (v >> 8); // pairs
+			v = ((v & 0x000000FF000000FF) * (100 + (1000000ull << 32)) + ((v >> 16) & 0x000000FF000000FF) * (1 + (10000ull << 32))) >> 32;
+			value = v;
+			return true;
+		}
+
+		// appends run of digits at p to mantissa, long runs 8 digits at a time
+		[[nodiscard]] constexpr const char* accumulate(const char* p, const char* const end, uint64_t& mantissa) {
+			uint64_t m = mantissa;
+			uint64_t eight = 0;
+			while (end - p >= 8 && is_digit(p[7]) && eight_digits(p, eight)) {
+				m = m * 100000000 + eight;
+				p += 8;
+			}
+			for (; p != end && is_digit(*p); ++p)
+				m = m * 10 + static_cast<uint64_t>(*p - '0');
+			mantissa = m;
+			return p;
+		}
+
+		// literal of any length as decimal digits with value 0.d[0]d[1]... * 10^dp, exact up to max_digits digits.
+		// slow path for what fast one cannot round exactly: digits are shifted by powers of two until value is
+		// in [1, 2) times 2^exp, then 53 bits are taken rounded half to even, as in simple decimal conversion of Go's strconv.
+		// plain constexpr, so it serves compile time parsing where std::from_chars is not available
+		class big_decimal {
+			static constexpr int max_digits = 800;
+			static constexpr unsigned max_shift = 60; // 9 << 60 plus carry still fits uint64_t
+
+			std::array<uint8_t, max_digits> _d{};
+			int _nd{ 0 };
+			int _dp{ 0 };
+			bool _trunc{ false }; // nonzero digits beyond max_digits were dropped
+
+			constexpr void trim() {
+				while (_nd > 0 && _d[_nd - 1] == 0) --_nd;
+				if (_nd == 0) _dp = 0;
+			}
+
+			constexpr void right_shift(const unsigned k) {
+				int r = 0, w = 0;
+				uint64_t n = 0;
+				for (; (n >> k) == 0; ++r) {
+					if (r >= _nd) {
+						if (n == 0) {
+							_nd = 0;
+							return;
+						}
+						while ((n >> k) == 0) {
+							n *= 10;
+							++r;
+						}
+						break;
+					}
+					n = n * 10 + _d[r];
+				}
+				_dp -= r - 1;
+				const uint64_t mask = (uint64_t{ 1 } << k) - 1;
+				for (; r < _nd; ++r) {
+					const uint64_t digit = n >> k;
+					n &= mask;
+					_d[w++] = static_cast<uint8_t>(digit);
+					n = n * 10 + _d[r];
+				}
+				while (n > 0) {
+					const uint64_t digit = n >> k;
+					n &= mask;
+					if (w < max_digits) _d[w++] = static_cast<uint8_t>(digit);
+					else if (digit > 0) _trunc = true;
+					n *= 10;
+				}
+				_nd = w;
+				trim();
+			}
+
+			constexpr void left_shift(const unsigned k) {
+				// product digits are produced lowest first, top max_digits of them are kept
+				std::array<uint8_t, max_digits + 20> low_first{};
+				int n_out = 0;
+				uint64_t carry = 0;
+				for (int r = _nd; r-- > 0;) {
+					const uint64_t n = (uint64_t{ _d[r] } << k) + carry;
+					low_first[n_out++] = static_cast<uint8_t>(n % 10);
+					carry = n / 10;
+				}
+				for (; carry > 0; carry /= 10)
+					low_first[n_out++] = static_cast<uint8_t>(carry % 10);
+				_dp += n_out - _nd;
+				const int dropped = n_out > max_digits ? n_out - max_digits : 0;
+				for (int i = 0; i < dropped; ++i) {
+					if (low_first[i] != 0) _trunc = true;
+				}
+				_nd = n_out - dropped;
+				for (int i = 0; i < _nd; ++i)
+					_d[i] = low_first[n_out - 1 - i];
+				trim();
+			}
+
+			// multiplies by 2^k, k may be negative
+			constexpr void shift(int k) {
+				if (_nd == 0) return;
+				for (; k > static_cast<int>(max_shift); k -= max_shift) left_shift(max_shift);
+				for (; k < -static_cast<int>(max_shift); k += max_shift) right_shift(max_shift);
+				if (k > 0) left_shift(static_cast<unsigned>(k));
+				else if (k < 0) right_shift(static_cast<unsigned>(-k));
+			}
+
+			[[nodiscard]] constexpr uint64_t rounded_integer() const {
+				uint64_t n = 0;
+				int i = 0;
+				for (; i < _dp && i < _nd; ++i) n = n * 10 + _d[i];
+				for (; i < _dp; ++i) n *= 10;
+				bool up = false;
+				if (_dp >= 0 && _dp < _nd) {
+					// exactly halfway rounds to even, unless dropped digits make it a little higher
+					if (_d[_dp] == 5 && _dp + 1 == _nd) up = _trunc || (_dp > 0 && _d[_dp - 1] % 2 == 1);
+					else up = _d[_dp] >= 5;
+				}
+				return n + (up ? 1 : 0);
+			}
+
+		public:
+			// digits of literal in [begin, end) with optional '.', times 10^exp10
+			constexpr big_decimal(const char* begin, const char* const end, const int64_t exp10) {
+				bool dot = false;
+				for (; begin != end; ++begin) {
+					if (*begin == '.') {
+						dot = true;
+						_dp = _nd;
+						continue;
+					}
+					const auto digit = static_cast<uint8_t>(*begin - '0');
+					if (digit == 0 && _nd == 0) {
+						--_dp; // leading zero
+						continue;
+					}
+					if (_nd < max_digits) _d[_nd++] = digit;
+					else if (digit != 0) _trunc = true;
+				}
+				if (!dot) _dp = _nd;
+				_dp += static_cast<int>(exp10);
+				trim();
+			}
+
+			// nearest double, inf when it overflows and 0 when it underflows like strtod
+			[[nodiscard]] constexpr num_t to_double() {
+				constexpr int mant_bits = 52, bias = -1023, max_exp = 0x7FF;
+				constexpr num_t inf = std::numeric_limits<num_t>::infinity();
+				if (_nd == 0) return num_t{ 0 };
+				if (_dp > 310) return inf;
+				if (_dp < -330) return num_t{ 0 };
+
+				// bits per decimal digit of dp, to approach [0.5, 1) in few shifts
+				constexpr int powtab[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+				const auto step = [&](const int dp) { return dp >= static_cast<int>(std::size(powtab)) ? 27 : powtab[dp]; };
+				int exp = 0;
+				while (_dp > 0) {
+					const int n = step(_dp);
+					shift(-n);
+					exp += n;
+				}
+				while (_dp < 0 || (_dp == 0 && _d[0] < 5)) {
+					const int n = step(-_dp);
+					shift(n);
+					exp -= n;
+				}
+				--exp; // [0.5, 1) to [1, 2)
+
+				// below smallest normal exponent becomes subnormal
+				if (exp < bias + 1) {
+					const int n = bias + 1 - exp;
+					shift(-n);
+					exp += n;
+				}
+				if (exp - bias >= max_exp) return inf;
+
+				shift(1 + mant_bits);
+				uint64_t mant = rounded_integer();
+				if (mant == uint64_t{ 2 } << mant_bits) {
+					mant >>= 1;
+					if (++exp - bias >= max_exp) return inf;
+				}
+				if (mant == 0) return num_t{ 0 };
+				if ((mant & (uint64_t{ 1 } << mant_bits)) == 0) exp = bias;
+
+				const uint64_t bits = (mant & ((uint64_t{ 1 } << mant_bits) - 1)) | (static_cast<uint64_t>(exp - bias) << mant_bits);
+				return std::bit_cast<num_t>(bits);
+			}
+		};
+	}
+
+	// number literal at s[idx]: digits, optional fraction of at least 1 digit and optional exponent as in 1e-9.
+	// e without digits after it is not part of number, so 2e stays number 2 followed by e.
+	// result is correctly rounded: up to 19 significant digits scaled by at most 10^22 are computed exactly,
+	// anything else goes to std::from_chars, or to detail::big_decimal during compile time evaluation.
+	// idx is moved past literal, nullopt on bad literal. literal out of double range is inf or 0 like strtod
+	[[nodiscard]] constexpr std::optional<num_t> parse_number(const std::string_view s, size_t& idx) {
+		// upon call idx guaranteed to be in bound and point to digit
+		const char* const begin = s.data() + idx;
+		const char* const end = s.data() + s.size();
+		const char* p = begin;
+
+		// digits are accumulated with wraparound, more than 19 significant ones go to from_chars anyway
+		uint64_t mantissa = 0;
+		p = detail::accumulate(p, end, mantissa);
+		const char* const int_end = p;
+		int64_t exp10 = 0;
+		if (p != end && *p == '.') {
+			++p;
+			// requires at least 1 digit after .
+			if (p == end || !detail::is_digit(*p)) return std::nullopt;
+			p = detail::accumulate(p, end, mantissa);
+			exp10 = int_end + 1 - p;
+		}
+		const char* const digits_end = p;
+
+		int64_t exponent = 0; // of e part alone
+		if (end - p >= 2 && (*p == 'e' || *p == 'E')) {
+			const char* q = p + 1;
+			const bool negative = *q == '-';
+			if (*q == '+' || *q == '-') ++q;
+			if (q != end && detail::is_digit(*q)) {
+				int64_t e = 0;
+				for (; q != end && detail::is_digit(*q); ++q) {
+					if (e < 100000) e = e * 10 + (*q - '0');
+				}
+				exponent = negative ? -e : e;
+				exp10 += exponent;
+				p = q;
+			}
+		}
+		idx += static_cast<size_t>(p - begin);
+
+		int64_t n_digits = digits_end - begin - (digits_end != int_end ? 1 : 0);
+		if (n_digits > 19) {
+			// leading zeros are not significant
+			for (const char* z = begin; z != digits_end && (*z == '0' || *z == '.'); ++z)
+				n_digits -= *z == '0';
+		}
+		if (n_digits <= 19 && mantissa <= (uint64_t{ 1 } << 53) && exp10 >= -22 && exp10 <= 22) {
+			const double m = static_cast<double>(mantissa);
+			if (exp10 == 0) return m;
+			return exp10 < 0 ? m / detail::exact_pow10[static_cast<size_t>(-exp10)] : m * detail::exact_pow10[static_cast<size_t>(exp10)];
+		}
+
+		if (std::is_constant_evaluated()) return detail::big_decimal(begin, digits_end, exponent).to_double();
+		num_t d{ 0 };
+		const auto [ptr, ec] = std::from_chars(begin, p, d);
+		if (ptr != p) return std::nullopt;
+		// from_chars leaves d as it is when out of range, inf or 0 is decided on digits
+		if (ec == std::errc::result_out_of_range) return detail::big_decimal(begin, digits_end, exponent).to_double();
+		if (ec != std::errc{}) return std::nullopt;
+		return d;
+	}
+}
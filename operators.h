@@ -1,10 +1,12 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
+#include <cstddef>
 #include "common_types.h"
 
 namespace defs
 {
-	enum class lex
+	enum class lex : uint8_t
 	{
 		begin,
 		lb,
@@ -36,48 +38,50 @@ namespace defs
 		error
 	};
 
+	inline constexpr size_t n_lexes = static_cast<size_t>(lex::error) + 1;
+
 	enum class associativity { left, right, none };
 
 	class op_defs {
 	public:
-		inline static const num_empty_t pi_f = [] { return cnum_t { 3.1415926535897932384626433832795028841968 }; };
+		inline static constexpr num_empty_t pi_f = [] { return cnum_t { 3.1415926535897932384626433832795028841968 }; };
 
-		inline static const num_2num_t add_f = [](cnum_t a, cnum_t b) { return a + b; };
-		inline static const num_2num_t sub_f = [](cnum_t a, cnum_t b) { return a - b; };
-		inline static const num_2num_t mul_f = [](cnum_t a, cnum_t b) { return a * b; };
-		inline static const num_2num_t div_f = [](cnum_t a, cnum_t b) { return a / b; };
-		inline static const num_2num_t pow_f = [](cnum_t a, cnum_t b) { return std::pow(a, b); };
-		inline static const num_2num_t min_f = [](cnum_t a, cnum_t b) { return std::min(a, b); };
-		inline static const num_2num_t max_f = [](cnum_t a, cnum_t b) { return std::max(a, b); };
-		inline static const num_2num_t atan2_f = [](cnum_t a, cnum_t b) { return std::atan2(a, b); };
+		inline static constexpr num_2num_t add_f = [](cnum_t a, cnum_t b) { return a + b; };
+		inline static constexpr num_2num_t sub_f = [](cnum_t a, cnum_t b) { return a - b; };
+		inline static constexpr num_2num_t mul_f = [](cnum_t a, cnum_t b) { return a * b; };
+		inline static constexpr num_2num_t div_f = [](cnum_t a, cnum_t b) { return a / b; };
+		inline static constexpr num_2num_t pow_f = [](cnum_t a, cnum_t b) { return std::pow(a, b); };
+		inline static constexpr num_2num_t min_f = [](cnum_t a, cnum_t b) { return std::min(a, b); };
+		inline static constexpr num_2num_t max_f = [](cnum_t a, cnum_t b) { return std::max(a, b); };
+		inline static constexpr num_2num_t atan2_f = [](cnum_t a, cnum_t b) { return std::atan2(a, b); };
 
-		inline static const num_1num_t neg_f   = [](cnum_t a) { return -a; };
-		inline static const num_1num_t sin_f   = [](cnum_t a) { return std::sin(a); };
-		inline static const num_1num_t cos_f   = [](cnum_t a) { return std::cos(a); };
-		inline static const num_1num_t tan_f   = [](cnum_t a) { return std::tan(a); };
-		inline static const num_1num_t ctn_f   = [](cnum_t a) { return cnum_t{1}/std::tan(a); };
-		inline static const num_1num_t atan_f  = [](cnum_t a) { return std::atan(a); };
-		inline static const num_1num_t sing_f  = [](cnum_t a) { return a > cnum_t{0} ? cnum_t{1} : (a < cnum_t{0} ? cnum_t{-1} : cnum_t{ 0 }); };
-		inline static const num_1num_t exp_f   = [](cnum_t a) { return std::exp(a); };
-		inline static const num_1num_t ln_f    = [](cnum_t a) { return std::log(a); };
-		inline static const num_1num_t log_f   = [](cnum_t a) { return std::log10(a); };
-		inline static const num_1num_t floor_f = [](cnum_t a) { return std::floor(a); };
-		inline static const num_1num_t ceil_f  = [](cnum_t a) { return std::ceil(a); };
-		inline static const num_1num_t round_f = [](cnum_t a) { return std::round(a); };
-		inline static const num_1num_t abs_f   = [](cnum_t a) { return std::abs(a); };
+		inline static constexpr num_1num_t neg_f   = [](cnum_t a) { return -a; };
+		inline static constexpr num_1num_t sin_f   = [](cnum_t a) { return std::sin(a); };
+		inline static constexpr num_1num_t cos_f   = [](cnum_t a) { return std::cos(a); };
+		inline static constexpr num_1num_t tan_f   = [](cnum_t a) { return std::tan(a); };
+		inline static constexpr num_1num_t ctn_f   = [](cnum_t a) { return cnum_t{1}/std::tan(a); };
+		inline static constexpr num_1num_t atan_f  = [](cnum_t a) { return std::atan(a); };
+		inline static constexpr num_1num_t sing_f  = [](cnum_t a) { return a > cnum_t{0} ? cnum_t{1} : (a < cnum_t{0} ? cnum_t{-1} : cnum_t{ 0 }); };
+		inline static constexpr num_1num_t exp_f   = [](cnum_t a) { return std::exp(a); };
+		inline static constexpr num_1num_t ln_f    = [](cnum_t a) { return std::log(a); };
+		inline static constexpr num_1num_t log_f   = [](cnum_t a) { return std::log10(a); };
+		inline static constexpr num_1num_t floor_f = [](cnum_t a) { return std::floor(a); };
+		inline static constexpr num_1num_t ceil_f  = [](cnum_t a) { return std::ceil(a); };
+		inline static constexpr num_1num_t round_f = [](cnum_t a) { return std::round(a); };
+		inline static constexpr num_1num_t abs_f   = [](cnum_t a) { return std::abs(a); };
 
-		inline static const num_1bool_2num_t if_f = [](cbool_t cond, cnum_t a, cnum_t b) { return cond ? a : b; };
+		inline static constexpr num_1bool_2num_t if_f = [](cbool_t cond, cnum_t a, cnum_t b) { return cond ? a : b; };
 
-		inline static const bool_2num_t equal_f      = [](cnum_t a, cnum_t b) { return a == b; };
-		inline static const bool_2num_t not_equal_f  = [](cnum_t a, cnum_t b) { return a != b; };
-		inline static const bool_2num_t less_f       = [](cnum_t a, cnum_t b) { return a < b; };
-		inline static const bool_2num_t less_equal_f = [](cnum_t a, cnum_t b) { return a <= b; };
-		inline static const bool_2num_t more_f       = [](cnum_t a, cnum_t b) { return a > b; };
-		inline static const bool_2num_t more_equal_f = [](cnum_t a, cnum_t b) { return a >= b; };
+		inline static constexpr bool_2num_t equal_f      = [](cnum_t a, cnum_t b) { return a == b; };
+		inline static constexpr bool_2num_t not_equal_f  = [](cnum_t a, cnum_t b) { return a != b; };
+		inline static constexpr bool_2num_t less_f       = [](cnum_t a, cnum_t b) { return a < b; };
+		inline static constexpr bool_2num_t less_equal_f = [](cnum_t a, cnum_t b) { return a <= b; };
+		inline static constexpr bool_2num_t more_f       = [](cnum_t a, cnum_t b) { return a > b; };
+		inline static constexpr bool_2num_t more_equal_f = [](cnum_t a, cnum_t b) { return a >= b; };
 
-		inline static const bool_2bool_t logic_and_f = [](cbool_t a, cbool_t b) { return a && b; };
-		inline static const bool_2bool_t logic_or_f  = [](cbool_t a, cbool_t b) { return a || b; };
-		inline static const bool_2bool_t logic_xor_f = [](cbool_t a, cbool_t b) { return a != b; };
+		inline static constexpr bool_2bool_t logic_and_f = [](cbool_t a, cbool_t b) { return a && b; };
+		inline static constexpr bool_2bool_t logic_or_f  = [](cbool_t a, cbool_t b) { return a || b; };
+		inline static constexpr bool_2bool_t logic_xor_f = [](cbool_t a, cbool_t b) { return a != b; };
 	};
 
   constexpr auto is_operator(const lex l) -> bool {
@@ -0,0 +1,115 @@
+#pragma once
+#include <vector>
+#include <variant>
+#include <span>
+#include <memory_resource>
+
+#include "maps.h"
+#include "type_check.h"
+
+namespace solver
+{
+	// applies operator or function to literal arguments given in call order, same semantics as rpn_compute
+	[[nodiscard]] static std::variant<num_t, bool_t> apply_term(const Term& term, std::span<const std::variant<num_t, bool_t>> args) {
+		const auto num = [&](const size_t i) { return std::get<num_t>(args[i]); };
+		const auto bln = [&](const size_t i) { return std::get<bool_t>(args[i]); };
+		switch (term.index()) {
+			case 0: return std::get<0>(term);
+			case 1: return std::get<1>(term);
+			case 2: return std::get<2>(term)(num(0));
+			case 3: {
+				const auto f = std::get<3>(term);
+				if (args.size() == 2) return f(num(0), num(1));
+				// min and max fold from last argument
+				num_t r = num(args.size() - 1);
+				for (size_t i = args.size() - 1; i-- > 0;)
+					r = f(r, num(i));
+				return r;
+			}
+			case 4: return std::get<4>(term)(bln(0), num(1), num(2));
+			case 5: return std::get<5>(term)(num(0), num(1));
+			case 6: return std::get<6>(term)(bln(0), bln(1));
+			default: return std::get<7>(term)();
+		}
+	}
+
+	static lex_wrapper literal(const std::variant<num_t, bool_t>& v) {
+		if (v.index() == 0)
+			return { lex::number, std::get<num_t>(v) };
+		return { lex::boolean, std::get<bool_t>(v) };
+	}
+
+	// constant folding over output of shunting_yard::run.
+	// every subtree without variables is evaluated once and replaced by single number or boolean token,
+	// if() with constant condition is replaced by the taken branch. braces, begin and end are dropped.
+	// result and scratch memory come from mr
+	[[nodiscard]] static std::variant<std::pmr::vector<lex_wrapper>, error> fold_constants(std::span<const lex_wrapper> postfix,
+		std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+		if (const auto types = infer_types(postfix, mr); types.index() == 1)
+			return std::get<error>(types);
+
+		struct entry {
+			size_t start; // first token of subtree in out
+			bool is_const;
+		};
+
+		std::pmr::vector<lex_wrapper> out(mr);
+		std::pmr::vector<entry> st(mr);
+		std::pmr::vector<std::variant<num_t, bool_t>> args(mr);
+		out.reserve(postfix.size());
+
+		for (const auto& lw : postfix) {
+			if (is_postfix_noop(lw.lex_type)) continue;
+
+			if (lw.lex_type == lex::number || lw.lex_type == lex::boolean) {
+				st.push_back({ out.size(), true });
+				out.push_back(lw);
+				continue;
+			}
+			if (lw.lex_type == lex::variable) {
+				st.push_back({ out.size(), false });
+				out.push_back(lw);
+				continue;
+			}
+
+			const Term term = std::get<Term>(resolve_term(lw));
+			const size_t n_args = lw.lex_type == lex::constant ? 0 : lw.n_args;
+			const auto first = st.end() - static_cast<std::ptrdiff_t>(n_args);
+			const size_t start = n_args == 0 ? out.size() : first->start;
+
+			if (std::all_of(first, st.end(), [](const entry& e) { return e.is_const; })) {
+				// all arguments are literals by now
+				args.clear();
+				for (auto it = first; it != st.end(); ++it) {
+					const lex_wrapper& a = out[it->start];
+					args.emplace_back(a.lex_type == lex::number ? std::variant<num_t, bool_t>{ a.number() } : a.boolean());
+				}
+				const lex_wrapper folded = literal(apply_term(term, args));
+				st.erase(first, st.end());
+				out.erase(out.begin() + static_cast<std::ptrdiff_t>(start), out.end());
+				st.push_back({ out.size(), true });
+				out.push_back(folded);
+				continue;
+			}
+
+			if (std::holds_alternative<num_1bool_2num_t>(term) && first->is_const) {
+				// if(constant, a, b): keep only taken branch
+				const bool cond = out[first->start].boolean();
+				const entry taken = cond ? first[1] : first[2];
+				const size_t taken_end = cond ? first[2].start : out.size();
+				std::pmr::vector<lex_wrapper> branch(out.begin() + static_cast<std::ptrdiff_t>(taken.start), out.begin() + static_cast<std::ptrdiff_t>(taken_end), mr);
+				st.erase(first, st.end());
+				out.erase(out.begin() + static_cast<std::ptrdiff_t>(start), out.end());
+				st.push_back({ out.size(), taken.is_const });
+				out.insert(out.end(), branch.begin(), branch.end());
+				continue;
+			}
+
+			st.erase(first, st.end());
+			st.push_back({ start, false });
+			out.push_back(lw);
+		}
+
+		return out;
+	}
+}
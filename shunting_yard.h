@@ -7,6 +7,7 @@
 //#include <complex>
 
 #include "maps.h"
+#include "compiled_expression.h"
 
 namespace solver
 {
@@ -21,19 +22,24 @@ namespace solver
 	    _vec(std::move(vec)), _variables(std::move(vars)) {}
 
 		[[nodiscard]] std::vector<lex_wrapper> run() const {
+			return run(_vec);
+		}
+
+		// infix tokens to postfix, needs no variable values
+		[[nodiscard]] static std::vector<lex_wrapper> run(const std::vector<lex_wrapper>& vec) {
 			std::stack<lex_wrapper> st;
 			std::vector<lex_wrapper> out;
 			size_t idx = 0;
-			for (const auto& lw : _vec) {
+			for (const auto& lw : vec) {
 				if (lw.lex_type == lex::number || lw.lex_type == lex::constant || lw.lex_type == lex::variable)
 					out.push_back(lw);
 				else if (lw.lex_type == lex::function)
 					st.push(lw);
 				else if (is_operator(lw.lex_type)) {
 					while (!st.empty() && is_operator(st.top().lex_type) &&
-						(std::get<1>(op_props[lw.lex_type]) < std::get<1>(op_props[st.top().lex_type]) ||
-						(std::get<1>(op_props[lw.lex_type]) == std::get<1>(op_props[st.top().lex_type]) &&
-						 std::get<2>(op_props[lw.lex_type]) == associativity::left))) {
+						(op_prop(lw.lex_type).precedence < op_prop(st.top().lex_type).precedence ||
+						(op_prop(lw.lex_type).precedence == op_prop(st.top().lex_type).precedence &&
+						 op_prop(lw.lex_type).assoc == associativity::left))) {
 						out.push_back(st.top());
 						st.pop();
 					}
@@ -78,19 +84,19 @@ namespace solver
 			std::vector<Term> terms;
 			std::ranges::for_each(vec_lw, [&](const lex_wrapper& lw) {
 				if (lw.lex_type == lex::number)
-					terms.emplace_back(std::get<num_t>(lw.data));
+					terms.emplace_back(lw.number());
 				if (lw.lex_type == lex::variable)
-					terms.emplace_back(_variables.at(std::get<std::string>(lw.data)));
+					terms.emplace_back(_variables.at(lw.name()));
 				else if (lw.lex_type == lex::boolean)
-					terms.emplace_back(std::get<bool_t>(lw.data));
+					terms.emplace_back(lw.boolean());
 				else if (is_operator(lw.lex_type)) {
 					terms.emplace_back(op_map.at(lw.lex_type));
 				}
 				else if (lw.lex_type == lex::function) {
-					terms.emplace_back(func_map.at(std::get<std::string>(lw.data)));
+					terms.emplace_back(func_map.at(lw.name()));
 				}
 				else if (lw.lex_type == lex::constant) {
-					terms.emplace_back(const_map.at(std::get<std::string>(lw.data)));
+					terms.emplace_back(const_map.at(lw.name()));
 				}
 			});
 
@@ -191,6 +197,11 @@ namespace solver
 			return std::numeric_limits<num_t>::quiet_NaN();
 		}
 
+		// run shunting yard once and keep the resulting program for repeated evaluation
+		[[nodiscard]] std::variant<compiled_expression, error> compile() const {
+			return compiled_expression::compile(run());
+		}
+
 		[[nodiscard]] std::variant<num_t, bool_t, error> solve() const {
 
 			// run shunting yard algorithm
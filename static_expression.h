@@ -0,0 +1,347 @@
+#pragma once
+#include <array>
+#include <span>
+#include <string_view>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include <optional>
+#include <variant>
+
+#include "common_types.h"
+#include "operators.h"
+#include "maps.h"
+#include "number_parser.h"
+
+namespace solver
+{
+	// string literal usable as template argument: compile<"a*sin(b)+c">()
+	template<size_t N>
+	struct fixed_string {
+		char data[N]{};
+
+		consteval fixed_string(const char (&s)[N]) { std::copy_n(s, N, data); }
+
+		[[nodiscard]] constexpr size_t size() const { return N - 1; }
+		[[nodiscard]] constexpr std::string_view view() const { return { data, N - 1 }; }
+	};
+
+	// constexpr counterparts of tokenizer and shunting_yard for expressions known at compile time, reading the same
+	// operator and function tables of maps.h.
+	// parse errors are reported as compile errors naming one of functions in ct::parse_error
+	namespace ct
+	{
+		using defs::lex;
+		using defs::num_t;
+		using defs::bool_t;
+		using defs::value_type;
+
+		// called only when expression is malformed, not being constexpr they stop compilation with their name in message
+		namespace parse_error {
+			inline void empty_input() {}
+			inline void braces_not_matched() {}
+			inline void bad_tokens_sequence() {}
+			inline void unknown_token() {}
+			inline void bad_number() {}
+			inline void wrong_args_count() {}
+			inline void wrong_type() {}
+		}
+
+		constexpr bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+		constexpr bool is_alpha(const char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+		constexpr bool is_word_char(const char c) { return is_alpha(c) || is_digit(c); }
+		constexpr char to_lower(const char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+		constexpr bool equal_nocase(const std::string_view a, const std::string_view b) {
+			return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const char x, const char y) { return to_lower(x) == to_lower(y); });
+		}
+
+		struct node {
+			lex type{ lex::number };
+			value_type vt{ value_type::num };
+			num_t value{ 0 };
+			uint32_t id{ 0 };          // function, or slot of variable
+			uint32_t n_args{ 0 };
+			uint32_t first_child{ 0 }; // into program::children
+		};
+
+		// postfix program as tree: arguments of nodes[i] are nodes[children[first_child + k]]
+		template<size_t Cap>
+		struct program {
+			std::array<node, Cap> nodes{};
+			std::array<uint32_t, Cap> children{};
+			std::array<std::string_view, Cap> variables{}; // in slot order
+			size_t n_nodes{ 0 };
+			size_t n_vars{ 0 };
+			uint32_t root{ 0 };
+		};
+
+		template<fixed_string S>
+		consteval auto parse() {
+			constexpr size_t cap = S.size() + 1;
+			const std::string_view s = S.view();
+
+			// tokenizer
+			std::array<node, cap> infix{};
+			size_t n_infix = 0;
+			std::array<std::string_view, cap> vars{};
+			size_t n_vars = 0;
+			lex prev = lex::begin;
+			int depth = 0;
+			const auto push = [&](node n) {
+				if (!defs::can_follow(prev, n.type)) parse_error::bad_tokens_sequence();
+				prev = n.type;
+				if (n.type != lex::unary_plus) infix[n_infix++] = n;
+			};
+			for (size_t i = 0; i < s.size();) {
+				const char c = s[i];
+				if (c == ' ' || c == '\t') { ++i; continue; }
+
+				if (is_digit(c)) {
+					// same literals and rounding as tokenizer
+					const std::optional<num_t> d = defs::parse_number(s, i);
+					if (!d) parse_error::bad_number();
+					push({ .type = lex::number, .value = *d });
+					continue;
+				}
+
+				if (is_alpha(c)) {
+					const size_t start = i;
+					while (i < s.size() && is_word_char(s[i])) ++i;
+					const std::string_view w = s.substr(start, i - start);
+					const auto f = std::ranges::find_if(defs::function_defs, [w](const defs::function_def& d) { return equal_nocase(d.name, w); });
+					const auto k = std::ranges::find_if(defs::const_defs, [w](const defs::function_def& d) { return d.name == w; });
+					if (f != defs::function_defs.end())
+						push({ .type = lex::function, .id = static_cast<uint32_t>(f - defs::function_defs.begin()) });
+					else if (k != defs::const_defs.end())
+						push({ .type = lex::constant, .value = std::get<defs::num_empty_t>(k->action)() });
+					else {
+						// case-insensitive like functions and runtime tokenizer, first spelling names the slot
+						const auto v = std::find_if(vars.begin(), vars.begin() + static_cast<std::ptrdiff_t>(n_vars), [w](const std::string_view name) { return equal_nocase(name, w); });
+						if (v == vars.begin() + static_cast<std::ptrdiff_t>(n_vars)) vars[n_vars++] = w;
+						push({ .type = lex::variable, .id = static_cast<uint32_t>(v - vars.begin()) });
+					}
+					continue;
+				}
+
+				const char next = i + 1 < s.size() ? s[i + 1] : '\0';
+				if ((c == '<' || c == '>' || c == '=') && next == '=') {
+					push({ .type = c == '<' ? lex::less_equal : c == '>' ? lex::more_equal : lex::equal });
+					i += 2;
+					continue;
+				}
+				lex l = lex::error;
+				switch (c) {
+					case '(': l = lex::lb; ++depth; break;
+					case ')': l = lex::rb; if (--depth < 0) parse_error::braces_not_matched(); break;
+					case ',': l = lex::comma; break;
+					case '+': l = defs::can_follow(prev, lex::plus) ? lex::plus : lex::unary_plus; break;
+					case '-': l = defs::can_follow(prev, lex::minus) ? lex::minus : lex::unary_minus; break;
+					case '*': l = lex::multiply; break;
+					case '/': l = lex::divide; break;
+					case '^': l = lex::power; break;
+					case '<': l = lex::less; break;
+					case '>': l = lex::more; break;
+					case '|': l = lex::logic_or; break;
+					case '&': l = lex::logic_and; break;
+					default: parse_error::unknown_token();
+				}
+				push({ .type = l });
+				++i;
+			}
+			if (depth != 0) parse_error::braces_not_matched();
+			if (n_infix == 0) parse_error::empty_input();
+			if (!defs::can_follow(prev, lex::end)) parse_error::bad_tokens_sequence();
+
+			// shunting yard, argument counts of functions are kept next to their braces
+			std::array<node, cap> postfix{};
+			size_t n_postfix = 0;
+			std::array<node, cap> st{};
+			std::array<uint32_t, cap> commas{};
+			size_t n_st = 0;
+			const auto emit = [&](node n) {
+				if (n.type == lex::unary_minus) n.n_args = 1;
+				else if (n.type != lex::function) n.n_args = static_cast<uint32_t>(defs::op_prop(n.type).n_args);
+				postfix[n_postfix++] = n;
+			};
+			for (size_t k = 0; k < n_infix; ++k) {
+				const node& t = infix[k];
+				switch (t.type) {
+					case lex::number: case lex::constant: case lex::variable: emit(t); break;
+					case lex::function: st[n_st++] = t; break;
+					case lex::lb: commas[n_st] = 0; st[n_st++] = t; break;
+					case lex::comma:
+						while (n_st && st[n_st - 1].type != lex::lb) emit(st[--n_st]);
+						if (n_st < 2 || st[n_st - 2].type != lex::function) parse_error::bad_tokens_sequence();
+						++commas[n_st - 1];
+						break;
+					case lex::rb: {
+						while (st[n_st - 1].type != lex::lb) emit(st[--n_st]);
+						const uint32_t n_args = commas[--n_st] + 1;
+						if (n_st && st[n_st - 1].type == lex::function) {
+							node f = st[--n_st];
+							const defs::function_def& d = defs::function_defs[f.id];
+							if (defs::is_multi_arg_funcs(d.name) ? n_args < 1 : n_args != defs::term_args[d.action.index()])
+								parse_error::wrong_args_count();
+							f.n_args = n_args;
+							emit(f);
+						}
+						else if (n_args != 1) parse_error::bad_tokens_sequence();
+						break;
+					}
+					default: {
+						const defs::op_info& op = defs::op_prop(t.type);
+						while (n_st && defs::op_prop(st[n_st - 1].type).precedence != 0 &&
+							(op.precedence < defs::op_prop(st[n_st - 1].type).precedence ||
+							(op.precedence == defs::op_prop(st[n_st - 1].type).precedence && op.assoc == defs::associativity::left)))
+							emit(st[--n_st]);
+						st[n_st++] = t;
+					}
+				}
+			}
+			while (n_st) emit(st[--n_st]);
+
+			// tree with types
+			program<cap> prog{};
+			std::array<uint32_t, cap> operands{};
+			size_t n_operands = 0, n_children = 0;
+			for (size_t k = 0; k < n_postfix; ++k) {
+				node n = postfix[k];
+				const uint32_t first = static_cast<uint32_t>(n_operands - n.n_args);
+				n.first_child = static_cast<uint32_t>(n_children);
+				for (uint32_t a = 0; a < n.n_args; ++a)
+					prog.children[n_children++] = operands[first + a];
+				n_operands = first;
+
+				const auto arg_type = [&](const uint32_t a) { return prog.nodes[prog.children[n.first_child + a]].vt; };
+				const auto all_args = [&](const value_type t) {
+					for (uint32_t a = 0; a < n.n_args; ++a)
+						if (arg_type(a) != t) return false;
+					return true;
+				};
+				switch (n.type) {
+					case lex::less: case lex::less_equal: case lex::more: case lex::more_equal: case lex::equal:
+						if (!all_args(value_type::num)) parse_error::wrong_type();
+						n.vt = value_type::boolean;
+						break;
+					case lex::logic_or: case lex::logic_and: case lex::logic_xor:
+						if (!all_args(value_type::boolean)) parse_error::wrong_type();
+						n.vt = value_type::boolean;
+						break;
+					case lex::function:
+						if (std::holds_alternative<defs::num_1bool_2num_t>(defs::function_defs[n.id].action)) {
+							if (arg_type(0) != value_type::boolean || arg_type(1) != value_type::num || arg_type(2) != value_type::num)
+								parse_error::wrong_type();
+						}
+						else if (!all_args(value_type::num)) parse_error::wrong_type();
+						break;
+					default:
+						if (!all_args(value_type::num)) parse_error::wrong_type();
+				}
+
+				prog.nodes[k] = n;
+				operands[n_operands++] = static_cast<uint32_t>(k);
+			}
+			if (n_operands != 1) parse_error::bad_tokens_sequence();
+
+			prog.n_nodes = n_postfix;
+			prog.root = operands[0];
+			prog.n_vars = n_vars;
+			prog.variables = vars;
+			return prog;
+		}
+	}
+
+	// expression parsed, checked and lowered at compile time. evaluation is plain nested code specialized for
+	// the expression, compiler sees it whole and inlines it into the caller. variables take slots in order of
+	// their first appearance, variables lists their names
+	template<fixed_string S>
+	class static_expression
+	{
+		using lex = defs::lex;
+		using num_t = defs::num_t;
+		using bool_t = defs::bool_t;
+
+		static constexpr auto prog = ct::parse<S>();
+
+		template<uint32_t I, uint32_t K>
+		static constexpr uint32_t child = prog.children[prog.nodes[I].first_child + K];
+
+		template<uint32_t I>
+		static constexpr auto eval(const num_t* v) {
+			constexpr ct::node n = prog.nodes[I];
+			if constexpr (n.type == lex::number || n.type == lex::constant) return n.value;
+			else if constexpr (n.type == lex::variable) return v[n.id];
+			else if constexpr (n.type == lex::unary_minus) return -eval<child<I, 0>>(v);
+			else if constexpr (n.type == lex::function) return call<I>(v);
+			else {
+				const auto a = eval<child<I, 0>>(v);
+				if constexpr (n.type == lex::logic_and) return a && eval<child<I, 1>>(v);
+				else if constexpr (n.type == lex::logic_or) return a || eval<child<I, 1>>(v);
+				else {
+					const auto b = eval<child<I, 1>>(v);
+					if constexpr (n.type == lex::plus) return a + b;
+					else if constexpr (n.type == lex::minus) return a - b;
+					else if constexpr (n.type == lex::multiply) return a * b;
+					else if constexpr (n.type == lex::divide) return a / b;
+					else if constexpr (n.type == lex::power) return std::pow(a, b);
+					else if constexpr (n.type == lex::less) return bool_t{ a < b };
+					else if constexpr (n.type == lex::less_equal) return bool_t{ a <= b };
+					else if constexpr (n.type == lex::more) return bool_t{ a > b };
+					else if constexpr (n.type == lex::more_equal) return bool_t{ a >= b };
+					else if constexpr (n.type == lex::equal) return bool_t{ a == b };
+					else return bool_t{ a != b }; // logic_xor
+				}
+			}
+		}
+
+		// action of function_defs, pointer is constant here so compiler inlines it
+		template<uint32_t I>
+		static constexpr num_t call(const num_t* v) {
+			constexpr ct::node n = prog.nodes[I];
+			constexpr defs::Term action = defs::function_defs[n.id].action;
+			if constexpr (std::holds_alternative<defs::num_1bool_2num_t>(action)) return eval<child<I, 0>>(v) ? eval<child<I, 1>>(v) : eval<child<I, 2>>(v);
+			else if constexpr (std::holds_alternative<defs::num_2num_t>(action)) {
+				constexpr defs::num_2num_t f = std::get<defs::num_2num_t>(action);
+				return [v]<uint32_t... K>(std::integer_sequence<uint32_t, K...>) {
+					const num_t args[] = { eval<child<I, K>>(v)... };
+					return fold<f>(args);
+				}(std::make_integer_sequence<uint32_t, n.n_args>{});
+			}
+			else return std::get<defs::num_1num_t>(action)(eval<child<I, 0>>(v));
+		}
+
+		template<defs::num_2num_t F, uint32_t N>
+		static constexpr num_t fold(const num_t (&args)[N]) {
+			if constexpr (N == 2) return F(args[0], args[1]);
+			// more arguments fold from last one
+			num_t r = args[N - 1];
+			for (uint32_t i = N - 1; i-- > 0;)
+				r = F(r, args[i]);
+			return r;
+		}
+
+	public:
+		static constexpr size_t n_vars = prog.n_vars;
+		using result_type = decltype(eval<prog.root>(nullptr));
+
+		// names of variables in slot order
+		static constexpr std::span<const std::string_view> variables() { return { prog.variables.data(), n_vars }; }
+
+		constexpr result_type operator()(const num_t* vars) const { return eval<prog.root>(vars); }
+
+		constexpr result_type operator()(std::span<const num_t, n_vars> vars) const { return eval<prog.root>(vars.data()); }
+
+		template<typename... T>
+			requires (sizeof...(T) == n_vars && (std::is_arithmetic_v<T> && ...))
+		constexpr result_type operator()(const T... args) const {
+			const num_t vars[] = { static_cast<num_t>(args)..., num_t{ 0 } };
+			return eval<prog.root>(vars);
+		}
+	};
+
+	// solver::compile<"a*sin(b)+c">()(a, b, c)
+	template<fixed_string S>
+	constexpr static_expression<S> compile() { return {}; }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <functional>
+
+namespace defs
+{
+	// interned name: tokens carry a pointer to one copy of name owned by symbol_table instead of own std::string.
+	// symbol stays valid as long as table it came from, names of tables are compared by text
+	class symbol {
+		const std::string* _str{ nullptr };
+
+		explicit symbol(const std::string* s) : _str(s) {}
+		friend class symbol_table;
+	public:
+		symbol() = default;
+
+		[[nodiscard]] const std::string& str() const { return *_str; }
+		[[nodiscard]] bool empty() const { return _str == nullptr; }
+
+		bool operator==(const symbol& other) const { return _str == other._str || (_str && other._str && *_str == *other._str); }
+	};
+
+	// names of one owner: built-in vocabulary, tokenizer or equation set. nodes never move, so symbols stay valid
+	// until table is destroyed. not synchronized, filled before use and only read afterwards
+	class symbol_table {
+		struct sv_hash {
+			using is_transparent = void;
+			size_t operator()(const std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); }
+		};
+
+		std::unordered_set<std::string, sv_hash, std::equal_to<>> _names;
+
+	public:
+		[[nodiscard]] symbol intern(const std::string_view name) {
+			if (const auto it = _names.find(name); it != _names.end())
+				return symbol{ &*it };
+			return symbol{ &*_names.emplace(name).first };
+		}
+
+		// empty symbol for unknown name
+		[[nodiscard]] symbol find(const std::string_view name) const {
+			const auto it = _names.find(name);
+			return it == _names.end() ? symbol{} : symbol{ &*it };
+		}
+	};
+}
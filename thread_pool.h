@@ -0,0 +1,254 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+
+namespace solver
+{
+	// lock-free deque of Chase and Lev: owner pushes and pops at bottom, other workers steal from top.
+	// capacity is fixed per run, every task is pushed at most once per run so the buffer never wraps
+	class ws_deque {
+		std::atomic<int64_t> _top{ 0 };
+		std::atomic<int64_t> _bottom{ 0 };
+		std::unique_ptr<std::atomic<size_t>[]> _buf;
+		size_t _capacity{ 0 };
+
+	public:
+		// not thread safe, called between runs
+		void reset(const size_t capacity) {
+			if (capacity > _capacity) {
+				_buf = std::make_unique<std::atomic<size_t>[]>(capacity);
+				_capacity = capacity;
+			}
+			_top.store(0, std::memory_order_relaxed);
+			_bottom.store(0, std::memory_order_relaxed);
+		}
+
+		// owner only
+		void push(const size_t task) {
+			const int64_t b = _bottom.load(std::memory_order_relaxed);
+			_buf[static_cast<size_t>(b)].store(task, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		// owner only
+		bool pop(size_t& task) {
+			const int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+			_bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = _top.load(std::memory_order_relaxed);
+			if (t > b) {
+				_bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+			task = _buf[static_cast<size_t>(b)].load(std::memory_order_relaxed);
+			if (t < b) return true;
+
+			// last task, race against thieves
+			const bool won = _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+
+		// any thread
+		bool steal(size_t& task) {
+			int64_t t = _top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = _bottom.load(std::memory_order_acquire);
+			if (t >= b) return false;
+			task = _buf[static_cast<size_t>(t)].load(std::memory_order_relaxed);
+			return _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		}
+
+		// any thread, may be stale by the time it returns
+		[[nodiscard]] bool empty() const {
+			return _top.load(std::memory_order_acquire) >= _bottom.load(std::memory_order_acquire);
+		}
+	};
+
+	// runs dag of tasks on fixed number of threads, calling thread is worker 0.
+	// task becomes ready once all its predecessors finished, worker that finishes its last predecessor
+	// pushes it to own deque, idle workers steal from others. idle workers spin for a while and then sleep
+	// until a task is pushed or run is over. threads sleep between runs
+	class work_stealing_pool
+	{
+		using job_t = void(*)(void* ctx, size_t task, size_t worker);
+
+		size_t _n_workers;
+		std::vector<std::thread> _threads;
+		std::unique_ptr<ws_deque[]> _queues;
+
+		// state of current run
+		job_t _job{ nullptr };
+		void* _ctx{ nullptr };
+		std::span<const std::vector<size_t>> _successors;
+		std::unique_ptr<std::atomic<uint32_t>[]> _deps;
+		size_t _deps_size{ 0 };
+		std::atomic<size_t> _remaining{ 0 };
+
+		// sleeping workers wait for _wake to change, wake_idle bumps it only when someone sleeps
+		static constexpr int spin_limit = 64;
+		std::atomic<uint32_t> _wake{ 0 };
+		std::atomic<uint32_t> _sleeping{ 0 };
+
+		std::mutex _mtx;
+		std::condition_variable _start;
+		std::condition_variable _finish;
+		uint64_t _generation{ 0 };
+		size_t _active{ 0 };
+		bool _stop{ false };
+
+		void work(const size_t w) {
+			ws_deque& own = _queues[w];
+			size_t task = 0;
+			bool has_task = false; // first successor made ready runs next without going through deque
+			int idle = 0;
+			while (has_task || _remaining.load(std::memory_order_acquire) != 0) {
+				if (!has_task && !own.pop(task) && !steal(w, task)) {
+					if (++idle < spin_limit) std::this_thread::yield();
+					else {
+						idle = 0;
+						sleep();
+					}
+					continue;
+				}
+				idle = 0;
+				_job(_ctx, task, w);
+
+				const size_t done = task;
+				has_task = false;
+				for (const size_t s : _successors[done]) {
+					if (_deps[s].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+					if (has_task) {
+						own.push(s);
+						wake_idle();
+					}
+					else {
+						task = s;
+						has_task = true;
+					}
+				}
+				if (_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) wake_idle();
+			}
+		}
+
+		// sleeper announces itself before looking at deques for the last time and waker publishes its task
+		// before looking at _sleeping, seq_cst fences make sure at least one of them sees the other
+		void sleep() {
+			_sleeping.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const uint32_t seen = _wake.load(std::memory_order_acquire);
+			if (_remaining.load(std::memory_order_acquire) != 0 && !has_work())
+				_wake.wait(seen, std::memory_order_acquire);
+			_sleeping.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		void wake_idle() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (_sleeping.load(std::memory_order_relaxed) == 0) return;
+			_wake.fetch_add(1, std::memory_order_release);
+			_wake.notify_all();
+		}
+
+		[[nodiscard]] bool has_work() const {
+			for (size_t w = 0; w < _n_workers; ++w)
+				if (!_queues[w].empty()) return true;
+			return false;
+		}
+
+		bool steal(const size_t w, size_t& task) {
+			for (size_t k = 1; k < _n_workers; ++k) {
+				if (_queues[(w + k) % _n_workers].steal(task))
+					return true;
+			}
+			return false;
+		}
+
+		void worker_main(const size_t w) {
+			uint64_t seen = 0;
+			for (;;) {
+				{
+					std::unique_lock lk(_mtx);
+					_start.wait(lk, [&] { return _stop || _generation != seen; });
+					if (_stop) return;
+					seen = _generation;
+				}
+				work(w);
+				std::lock_guard lk(_mtx);
+				if (--_active == 0) _finish.notify_one();
+			}
+		}
+
+	public:
+		explicit work_stealing_pool(const size_t n_threads = std::thread::hardware_concurrency()) :
+			_n_workers(n_threads == 0 ? 1 : n_threads), _queues(std::make_unique<ws_deque[]>(_n_workers)) {
+			_threads.reserve(_n_workers - 1);
+			for (size_t w = 1; w < _n_workers; ++w)
+				_threads.emplace_back([this, w] { worker_main(w); });
+		}
+
+		work_stealing_pool(const work_stealing_pool&) = delete;
+		work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+		~work_stealing_pool() {
+			{
+				std::lock_guard lk(_mtx);
+				_stop = true;
+			}
+			_start.notify_all();
+			for (auto& t : _threads) t.join();
+		}
+
+		[[nodiscard]] size_t size() const { return _n_workers; }
+
+		// n_deps[i] is number of predecessors of task i, successors[i] lists tasks depending on i.
+		// task(i, worker) is called exactly once per task, worker is in [0, size())
+		template<typename F>
+		void run(std::span<const uint32_t> n_deps, std::span<const std::vector<size_t>> successors, F&& task) {
+			const size_t n = n_deps.size();
+			if (n == 0) return;
+
+			if (n > _deps_size) {
+				_deps = std::make_unique<std::atomic<uint32_t>[]>(n);
+				_deps_size = n;
+			}
+			for (size_t w = 0; w < _n_workers; ++w)
+				_queues[w].reset(n);
+
+			// initially ready tasks are dealt round-robin
+			size_t next = 0;
+			for (size_t i = 0; i < n; ++i) {
+				_deps[i].store(n_deps[i], std::memory_order_relaxed);
+				if (n_deps[i] == 0) _queues[next++ % _n_workers].push(i);
+			}
+
+			_job = [](void* ctx, const size_t i, const size_t w) { (*static_cast<std::remove_reference_t<F>*>(ctx))(i, w); };
+			_ctx = &task;
+			_successors = successors;
+			_remaining.store(n, std::memory_order_release);
+
+			if (_n_workers == 1) {
+				work(0);
+				return;
+			}
+
+			{
+				std::lock_guard lk(_mtx);
+				++_generation;
+				_active = _n_workers - 1;
+			}
+			_start.notify_all();
+			work(0);
+
+			// workers still may touch state of this run
+			std::unique_lock lk(_mtx);
+			_finish.wait(lk, [&] { return _active == 0; });
+		}
+	};
+}
@@ -8,19 +8,19 @@
 
 #include "fn_args_counter.h"
 #include "topo_sort.h"
+#include "shunting_yard.h"
+#include "optimizer.h"
+#include "cse.h"
+#include "thread_pool.h"
+#include "arena.h"
 
 using namespace defs;
 
 namespace solver
 {
-	void tokenizer::remove_whites() const {
-		const auto it = std::ranges::remove(_equation, ' ').begin();
-		_equation.erase(it, _equation.end());
-	}
-
-	bool tokenizer::braces_are_balanced() const {
+	bool tokenizer::braces_are_balanced(const context& ctx) {
 		size_t i = 0;
-		for (const char c : _equation) {
+		for (const char c : ctx.equation) {
 			if (c == '(')
 				++i;
 			else if (c == ')') {
@@ -32,46 +32,39 @@ namespace solver
 		return i == 0;
 	}
 
-	std::string tokenizer::read_word(size_t& idx) const {
+	std::string_view tokenizer::read_word(const context& ctx, size_t& idx) {
 		const size_t idxStart = idx;
-		while (idx < _len && is_word_char(_equation[idx])) {
+		while (idx < ctx.len && is_word_char(ctx.equation[idx])) {
 			++idx;
 		}
-		std::string w = _equation.substr(idxStart, idx - idxStart);
-		return w;
+		return ctx.equation.substr(idxStart, idx - idxStart);
 	}
 
-	lex_wrapper tokenizer::classify(lex prev_lex, size_t& idx) const {
-		if (idx > _len)
+	lex_wrapper tokenizer::classify(const context& ctx, lex prev_lex, size_t& idx) const {
+		if (idx > ctx.len)
 			return lex_wrapper{ lex::error, error::out_of_range };
 	
 		// check if last lex is correct
-		if (idx == _len) {
+		if (idx == ctx.len) {
 			return can_follow(prev_lex, lex::end) ? lex_end_w : lex_bad_tokens_seq_w;
 		}
 
 		// skip spaces
-		while (idx < _len && std::isspace(_equation[idx])) { ++idx; }
-		if (idx >= _len) return lex::space;
+		while (idx < ctx.len && std::isspace(ctx.equation[idx])) { ++idx; }
+		if (idx >= ctx.len) return lex::space;
 
 		// number
-		if (std::isdigit(_equation[idx])) {
-			if (std::optional<num_t> d = read_number<num_t>(idx); d.has_value())
+		if (std::isdigit(ctx.equation[idx])) {
+			if (std::optional<num_t> d = read_number<num_t>(ctx, idx); d.has_value())
 				return can_follow(prev_lex, lex::number) ? lex_wrapper{ lex::number, d.value() } : lex_bad_tokens_seq_w;
 
 			return lex_wrapper {lex::error, error::bad_number};
 		}
 		
 		// operator
-		if (!std::isalnum(_equation[idx]) && _equation[idx] != '_') {
-			const auto it = std::ranges::find_if(lex_operators::names, [this, idx](const std::string& name) {
-				if (idx + name.size() <= _len)
-					return name == _equation.substr(idx, name.size());
-				return false;
-				});
-	
-			if (it != lex_operators::names.end()) {
-				const std::vector<lex>& candidates = lex_oper_map.at(*it);
+		if (!std::isalnum(ctx.equation[idx]) && ctx.equation[idx] != '_') {
+			if (const operator_entry* op = operator_dispatch.match(ctx.equation.substr(idx)); op) {
+				const std::vector<lex>& candidates = *op->lexes;
 				const auto lexIt = std::ranges::find_if(candidates, [prev_lex](lex l) {
 					// find 1st which has prev_lex allowed
 					return can_follow(prev_lex, l);
@@ -81,38 +74,28 @@ namespace solver
 				if (lexIt == candidates.end())
 					return lex_bad_tokens_seq_w;
 	
-				idx += it->size();
-				return lex_wrapper{ *lexIt, *it };
+				idx += op->name->size();
+				return lex_wrapper{ *lexIt, op->sym };
 			}
 		}
 	
 		// function or const
-		if (std::isalpha(_equation[idx]) || _equation[idx] == '_') {
-			const std::string w = read_word(idx);
+		if (std::isalpha(ctx.equation[idx]) || ctx.equation[idx] == '_') {
+			const std::string_view w = read_word(ctx, idx);
 	
 			// function
-			const auto itf = std::ranges::find_if(lex_functions::names, [&w](const std::string& s) {
-				return std::ranges::equal(s, w, [](const char a, const char b) {
-					return std::tolower(a) == std::tolower(b);
-					});
-				});
-			if (itf != lex_functions::names.end()) {
-				return can_follow(prev_lex, lex::function) ? lex_wrapper{ lex::function, *itf } : lex_bad_tokens_seq_w;
+			if (const size_t f = function_index.find(w); f != name_index::npos) {
+				return can_follow(prev_lex, lex::function) ? lex_wrapper{ lex::function, function_symbols[f] } : lex_bad_tokens_seq_w;
 			}
 	
 			// variable
-			const auto itv = std::ranges::find_if(_variables, [&w](const std::string& s) {
-				return std::ranges::equal(s, w, [](const char a, const char b) {
-					return std::tolower(a) == std::tolower(b);
-					});
-				});
-			if (itv != _variables.end()) {
-				return can_follow(prev_lex, lex::variable) ? lex_wrapper{ lex::variable, w } : lex_bad_tokens_seq_w;
+			if (const size_t v = _variable_index.find(w); v != name_index::npos) {
+				return can_follow(prev_lex, lex::variable) ? lex_wrapper{ lex::variable, _variable_symbols[v] } : lex_bad_tokens_seq_w;
 			}
 	
 			// const
 			if (const auto itc = std::ranges::find(lex_consts::names, w); itc != lex_consts::names.end()) {
-				return can_follow(prev_lex, lex::constant) ? lex_wrapper{ lex::constant, *itc } : lex_bad_tokens_seq_w;
+				return can_follow(prev_lex, lex::constant) ? lex_wrapper{ lex::constant, constant_symbols[static_cast<size_t>(itc - lex_consts::names.begin())] } : lex_bad_tokens_seq_w;
 			}
 		}
 	
@@ -120,19 +103,18 @@ namespace solver
 	}
 	
 	std::vector<lex_wrapper> tokenizer::parseSingle(const std::string& equaiton) const {
-		_equation = equaiton;
-		_len = equaiton.size();
+		const context ctx{ equaiton };
 		std::vector lexes{ lex_wrapper { lex::begin } };
 	
-		if (!braces_are_balanced()) {
+		if (!braces_are_balanced(ctx)) {
 			lexes.emplace_back(lex::error, error::braces_not_matched);
 			return lexes;
 		}
 	
 		size_t idx = 0;
 		lex_wrapper lw{ lex::begin };
-		while (idx < _len) {
-			lw = classify(lexes.back().lex_type, idx);
+		while (idx < ctx.len) {
+			lw = classify(ctx, lexes.back().lex_type, idx);
 			if (lw.lex_type == lex::space) continue;
 
 			lexes.push_back(lw);
@@ -150,7 +132,7 @@ namespace solver
 			const std::map<size_t, size_t> fn_args_count = fn_args_counter::get_fn_arguments_count(lexes);
 			if (const error err = fn_args_counter::validate_arguments(lexes, fn_args_count); err == error::success) {
 				if (!lexes.empty()) {
-					lw = classify(lexes.back().lex_type, idx);
+					lw = classify(ctx, lexes.back().lex_type, idx);
 					lexes.push_back(lw);
 				}
 				else
@@ -162,54 +144,230 @@ namespace solver
 			for (size_t i = 0, n = lexes.size(); i < n; ++i) {
 				if (lexes[i].lex_type == lex::function) {
 					if (fn_args_count.contains(i))
-						lexes[i].n_args = fn_args_count.at(i);
+						lexes[i].n_args = static_cast<uint32_t>(fn_args_count.at(i));
 				}
 				else
-					lexes[i].n_args = args_count(lexes[i].lex_type);
+					lexes[i].n_args = static_cast<uint32_t>(args_count(lexes[i].lex_type));
 			}
 		}
 	
 		return lexes;
 	}
 
-	std::variant<std::vector<std::string>, error> tokenizer::parse() const {
-		std::vector<std::string> names;
-		std::vector<std::vector<lex_wrapper>> eqs;
-		for (const auto &[name, eq]: _equations) {
-			const std::vector<lex_wrapper> eq_parsed = parseSingle(eq);
-			if (eq_parsed.empty()) return error::empty_input;
-			if (eq_parsed.back().lex_type == lex::error) {
-				const error err = eq_parsed.back().data.index() == 4 ? std::get<4>(eq_parsed.back().data) : error::unknown;
-				return err;
+	std::variant<std::pmr::vector<lex_wrapper>, error> tokenizer::parse_postfix(const std::string& equation, std::pmr::memory_resource* mr) const {
+		const context ctx{ equation };
+
+		std::pmr::vector<lex_wrapper> out(mr);
+		std::pmr::vector<lex_wrapper> st(mr);  // operators, functions and left braces
+		std::pmr::vector<size_t> calls(mr);     // positions in st of functions with open braces, innermost last
+		out.reserve(ctx.len);
+		size_t depth = 0;
+		error err = error::success;    // wrong_args_count gives way to errors of later tokens
+		lex prev = lex::begin;         // grammar is checked against it, unary plus included
+		lex last = lex::begin;         // last token kept
+		size_t idx = 0;
+		while (idx < ctx.len) {
+			const lex_wrapper lw = classify(ctx, prev, idx);
+			if (lw.lex_type == lex::space) continue;
+			if (lw.lex_type == lex::error) {
+				// unbalanced braces are reported before any other error
+				for (; idx < ctx.len; ++idx) {
+					if (ctx.equation[idx] == '(') ++depth;
+					else if (ctx.equation[idx] == ')' && depth-- == 0) return error::braces_not_matched;
+				}
+				return depth == 0 ? lw.err() : error::braces_not_matched;
 			}
 
-			names.push_back(name);
-			eqs.push_back(eq_parsed);
-		}
+			prev = lw.lex_type;
+			if (lw.lex_type == lex::unary_plus) continue;
+			last = lw.lex_type;
 
-		const size_t sz = names.size();
-		std::unordered_map<std::string, size_t> idx_names;
-		for (size_t i = 0; i < sz; ++i) { idx_names[names[i]] = i; }
-
-		// prepare Graph
-		std::vector<std::vector<size_t>> graph(sz, std::vector<size_t>());
-		for (size_t i = 0; i < sz; ++i) {
-			for (size_t j = 0; j < sz; ++j) {
-				if (std::any_of(eqs[i].begin(), eqs[i].end(), [&j, &names](const lex_wrapper& lw) {
-					return lw.lex_type == lex::variable ? std::get<3>(lw.data) == names[j] : false;
-				})) {
-					graph[i].push_back(j);
+			switch (lw.lex_type) {
+				case lex::number:
+				case lex::constant:
+				case lex::variable:
+					out.push_back(lw);
+					break;
+				case lex::function:
+					calls.push_back(st.size());
+					st.push_back(lw);
+					st.back().n_args = 1;
+					break;
+				case lex::lb:
+					++depth;
+					st.push_back(lw);
+					break;
+				case lex::comma:
+					while (!st.empty() && st.back().lex_type != lex::lb) {
+						out.push_back(st.back());
+						st.pop_back();
+					}
+					// commas in plain braces inside of call count too, like fn_args_counter does
+					if (!calls.empty()) ++st[calls.back()].n_args;
+					break;
+				case lex::rb:
+					if (depth-- == 0) return error::braces_not_matched;
+					while (st.back().lex_type != lex::lb) {
+						out.push_back(st.back());
+						st.pop_back();
+					}
+					st.pop_back();
+					if (!st.empty() && st.back().lex_type == lex::function) {
+						const size_t arity = function_arity(st.back().sym());
+						if (arity != 0 && arity != st.back().n_args && err == error::success)
+							err = error::wrong_args_count;
+						calls.pop_back();
+						out.push_back(st.back());
+						st.pop_back();
+					}
+					break;
+				default: {
+					const op_info& op = op_prop(lw.lex_type);
+					while (!st.empty() && is_operator(st.back().lex_type)) {
+						const int top = op_prop(st.back().lex_type).precedence;
+						if (op.precedence > top || (op.precedence == top && op.assoc != associativity::left)) break;
+						out.push_back(st.back());
+						st.pop_back();
+					}
+					st.push_back(lw);
+					st.back().n_args = static_cast<uint32_t>(args_count(lw.lex_type));
 				}
 			}
 		}
 
-		// run Graph algorithm here
-		solver::topo_sort ts { graph };
-		const auto order = ts.sort();
-		if (order.index() == 1)
+		if (depth != 0) return error::braces_not_matched;
+		if (err != error::success) return err;
+		if (last == lex::begin) return error::empty_input;
+		if (!can_follow(last, lex::end)) return error::bad_tokens_sequence;
+
+		while (!st.empty()) {
+			out.push_back(st.back());
+			st.pop_back();
+		}
+		return out;
+	}
+
+	void tokenizer::normalize(const std::string_view equation, std::string& out) const {
+		out.clear();
+		const auto is_number_char = [](const char c) { return std::isdigit(c) || c == '.'; };
+		const auto is_sign = [](const char c) { return c == '+' || c == '-'; };
+		const auto is_exponent = [](const char c) { return c == 'e' || c == 'E'; };
+		const auto is_punct = [&](const char c) { return !is_word_char(c) && !is_number_char(c) && c != '(' && c != ')' && c != ','; };
+
+		bool space = false;
+		for (size_t idx = 0, n = equation.size(); idx < n;) {
+			const char c = equation[idx];
+			if (std::isspace(c)) {
+				space = !out.empty();
+				++idx;
+				continue;
+			}
+			if (space) {
+				const char prev = out.back();
+				const bool word = (is_word_char(prev) || is_number_char(prev)) && (is_word_char(c) || is_number_char(c));
+				// 2e +5 and 2e+ 5 are not 2e+5
+				const bool exponent = (is_exponent(prev) && is_sign(c)) ||
+					(is_sign(prev) && is_number_char(c) && out.size() > 1 && is_exponent(out[out.size() - 2]));
+				if (word || exponent || (is_punct(prev) && is_punct(c))) out.push_back(' ');
+				space = false;
+			}
+
+			if (!std::isalpha(c) && c != '_') {
+				// numbers are copied as they are, together with letters of exponent
+				do out.push_back(equation[idx++]);
+				while (idx < n && std::isdigit(c) && (is_word_char(equation[idx]) || equation[idx] == '.'));
+				continue;
+			}
+
+			const size_t start = idx;
+			while (idx < n && is_word_char(equation[idx])) ++idx;
+			const std::string_view w = equation.substr(start, idx - start);
+			// functions and variables are looked up ignoring case, constants are not
+			if (function_index.find(w) != name_index::npos || _variable_index.find(w) != name_index::npos)
+				std::ranges::transform(w, std::back_inserter(out), fold_case);
+			else
+				out.append(w);
+		}
+	}
+
+	std::variant<std::vector<lex_wrapper>, error> tokenizer::compile_equation(const std::string& equation, std::pmr::memory_resource* scratch) const {
+		const auto postfix = parse_postfix(equation, scratch);
+		if (postfix.index() == 1) return std::get<error>(postfix);
+		const auto folded = fold_constants(std::get<0>(postfix), scratch);
+		if (folded.index() == 1) return std::get<error>(folded);
+		// only folded program outlives scratch
+		return std::vector<lex_wrapper>(std::get<0>(folded).begin(), std::get<0>(folded).end());
+	}
+
+	std::variant<equation_set, error> tokenizer::parse(std::vector<std::string>* cycle) const {
+		std::vector<std::variant<std::vector<lex_wrapper>, error>> compiled;
+		compiled.reserve(_equations.size());
+		arena scratch;
+		for (const auto& [name, eq] : _equations) {
+			scratch.reset();
+			compiled.push_back(compile_equation(eq, scratch.resource()));
+			if (compiled.back().index() == 1) return std::get<error>(compiled.back());
+		}
+		return link(std::move(compiled), cycle);
+	}
+
+	std::variant<equation_set, error> tokenizer::parse(work_stealing_pool& pool, std::vector<std::string>* cycle) const {
+		std::vector<const std::string*> sources;
+		sources.reserve(_equations.size());
+		for (const auto& [name, eq] : _equations) sources.push_back(&eq);
+
+		// chunks of equations keep pool overhead small against compiling single equation
+		const size_t n = sources.size();
+		const size_t chunk = std::max<size_t>(1, n / (pool.size() * 16));
+		const size_t n_chunks = (n + chunk - 1) / chunk;
+		std::vector<std::variant<std::vector<lex_wrapper>, error>> compiled(n);
+		const std::vector<uint32_t> n_deps(n_chunks, 0);
+		const std::vector<std::vector<size_t>> successors(n_chunks);
+		pool.run(n_deps, successors, [&](const size_t c, size_t) {
+			thread_local arena scratch;
+			for (size_t i = c * chunk, end = std::min(n, i + chunk); i < end; ++i) {
+				scratch.reset();
+				compiled[i] = compile_equation(*sources[i], scratch.resource());
+			}
+		});
+		return link(std::move(compiled), cycle);
+	}
+
+	std::variant<equation_set, error> tokenizer::link(std::vector<std::variant<std::vector<lex_wrapper>, error>> compiled, std::vector<std::string>* cycle) const {
+		equation_set set;
+		auto& names = set.names;
+		auto& eqs = set.postfix;
+		size_t i = 0;
+		for (const auto& [name, eq] : _equations) {
+			// first error in order of names, whichever thread found it
+			if (compiled[i].index() == 1) return std::get<error>(compiled[i]);
+			names.push_back(name);
+			eqs.push_back(std::move(std::get<0>(compiled[i++])));
+		}
+
+		set.n_equations = names.size();
+		std::ranges::copy_if(_variables, std::back_inserter(set.inputs), [this](const std::string& v) { return !_equations.contains(v); });
+
+		auto shared_symbols = std::make_shared<symbol_table>();
+		if (const auto res = eliminate_common_subexpressions(names, eqs, *shared_symbols); res.index() == 1)
+			return std::get<error>(res);
+		set.variable_symbols = _symbols;
+		set.shared_symbols = std::move(shared_symbols);
+
+		// prepare Graph, run Graph algorithm here
+		solver::topo_sort ts { build_dependency_graph(names, eqs) };
+		auto order = ts.sort();
+		if (order.index() == 1) {
+			if (cycle) {
+				cycle->clear();
+				for (const size_t i : ts.cycle()) cycle->push_back(names[i]);
+			}
 			return std::get<1>(order);
+		}
 
-		std::vector<std::string> vec(sz);
-		return vec;
+		set.graph = ts.release_graph();
+		set.order = std::move(std::get<0>(order));
+		set.levels = ts.levels();
+		return set;
 	}
 }
@@ -1,37 +1,76 @@
 #pragma once
 #include <string>
 #include <optional>
+#include <memory_resource>
+#include <memory>
 #include "maps.h"
+#include "keyword_index.h"
+#include "number_parser.h"
+#include "dependency_graph.h"
 #include <algorithm>
 
 using namespace defs;
 
 namespace solver
 {
+	class work_stealing_pool;
+
+	// equations of a system in postfix form, ordered by their dependencies
+	struct equation_set {
+		std::vector<std::string> inputs; // variables which are not equations
+		std::vector<std::string> names;  // shared subexpressions follow equations of the system
+		size_t n_equations{ 0 };         // number of equations of the system without shared subexpressions
+		std::vector<std::vector<lex_wrapper>> postfix;
+		csr_graph graph;                        // graph[i] lists equations referenced by equation i
+		std::vector<size_t> order;              // evaluation order, dependencies come first
+		std::vector<size_t> levels;             // equations of one level are independent of each other
+		// names variable tokens of postfix point to: variables of tokenizer and shared subexpressions
+		std::shared_ptr<const symbol_table> variable_symbols, shared_symbols;
+	};
+
 	class tokenizer {
-		mutable std::string _equation;
-		mutable size_t _len{};
 		std::vector<std::string> _variables;
+		name_index _variable_index;
+		// names of variables, tokens point to them so tokens stay valid as long as tokenizer or equation_set made by it
+		std::shared_ptr<const symbol_table> _symbols;
+		std::vector<symbol> _variable_symbols; // interned once, tokens only copy them
 		std::map<std::string, std::string> _equations;
 
-		void remove_whites() const;
+		// input of one call, kept out of members so const tokenizer can be used by several threads at once
+		struct context {
+			std::string_view equation;
+			size_t len;
+
+			explicit context(const std::string_view eq) : equation(eq), len(eq.size()) {}
+		};
 
 		static bool is_word_char(const char c) { return std::isalnum(c) || c == '_'; }
 
-		[[nodiscard]] bool braces_are_balanced() const;
+		[[nodiscard]] static bool braces_are_balanced(const context& ctx);
 
-		std::string read_word(size_t& idx) const;
+		static std::string_view read_word(const context& ctx, size_t& idx);
 
 		template<typename T>
-		std::optional<T> read_number(size_t& idx) const;
+		static std::optional<T> read_number(const context& ctx, size_t& idx);
 
-		lex_wrapper classify(lex prev_lex, size_t& idx) const;
+		lex_wrapper classify(const context& ctx, lex prev_lex, size_t& idx) const;
+
+		// postfix of one equation with constants folded, intermediate results go to scratch
+		[[nodiscard]] std::variant<std::vector<lex_wrapper>, error> compile_equation(const std::string& equation, std::pmr::memory_resource* scratch) const;
+
+		// equation set from compiled equations in order of _equations
+		[[nodiscard]] std::variant<equation_set, error> link(std::vector<std::variant<std::vector<lex_wrapper>, error>> compiled,
+			std::vector<std::string>* cycle) const;
 
 	public:
 		explicit tokenizer(std::vector<std::string> var_names, std::map<std::string, std::string> equations) :
 			_variables(std::move(var_names)), _equations(std::move(equations)) {
 			for (const auto& [name, _] : _equations)
 				_variables.insert(_variables.end(), name);
+			_variable_index = name_index{ _variables };
+			auto symbols = std::make_shared<symbol_table>();
+			std::ranges::transform(_variables, std::back_inserter(_variable_symbols), [&symbols](const std::string& v) { return symbols->intern(v); });
+			_symbols = std::move(symbols);
 		}
 
 		tokenizer() : tokenizer({}, {}) {}
@@ -40,43 +79,37 @@ namespace solver
 
 		[[nodiscard]] std::vector<lex_wrapper> parseSingle(const std::string& equaiton) const;
 
-		[[nodiscard]] std::variant<std::vector<std::string>, error> parse() const;
+		// tokenizes, validates and converts to postfix in one pass, result equals shunting_yard::run over parseSingle.
+		// arguments of functions are counted on operator stack, errors are reported with priority of parseSingle.
+		// result and working stacks are allocated from mr
+		[[nodiscard]] std::variant<std::pmr::vector<lex_wrapper>, error> parse_postfix(const std::string& equation,
+			std::pmr::memory_resource* mr = std::pmr::get_default_resource()) const;
+
+		// text equal for all inputs which parse the same up to whitespace and case of names of functions and variables,
+		// written to out. whitespace is kept (as single space) only where dropping it could join two tokens
+		void normalize(std::string_view equation, std::string& out) const;
+
+		// tokenizes every equation of the system, folds constants and shares common subexpressions between equations.
+		// on graph_cycle names of equations forming the cycle are stored to cycle when given
+		[[nodiscard]] std::variant<equation_set, error> parse(std::vector<std::string>* cycle = nullptr) const;
+
+		// same as parse, equations are compiled on pool and merged in order of their names,
+		// so result and reported error do not depend on number of threads
+		[[nodiscard]] std::variant<equation_set, error> parse(work_stealing_pool& pool, std::vector<std::string>* cycle = nullptr) const;
 	};
 
 	template<>
-	inline std::optional<num_t> tokenizer::read_number(size_t& idx) const {
-		// upon call idx guaranteed to be in bound and point to digit
-		num_t d { 0 };
-		do {
-			d = num_t{ 10 } * d + (_equation[idx++] - 0x30);
-		} while (idx < _len && std::isdigit(_equation[idx]));
-	
-		if (idx >= _len) return d;
-	
-		if (_equation[idx] == '.') {
-			++idx;
-			// requires at least 1 digit after .
-			if (idx >= _len || !std::isdigit(_equation[idx])) return std::nullopt;
-	
-			num_t f{ 0 }, mul{ 1 };
-			do {
-				mul /= num_t{ 10 };
-				f = f + mul * (_equation[idx++] - 0x30);
-			} while (idx < _len && std::isdigit(_equation[idx]));
-	
-			d += f;
-		}
-	
-		return d;
+	inline std::optional<num_t> tokenizer::read_number(const context& ctx, size_t& idx) {
+		return parse_number(ctx.equation, idx);
 	}
 
 	template<>
-	inline std::optional<int> tokenizer::read_number(size_t& idx) const {
+	inline std::optional<int> tokenizer::read_number(const context& ctx, size_t& idx) {
 		// upon call idx guaranteed to be in bound and point to digit
 		int d = 0;
 		do {
-			d = 10 * d + (_equation[idx++] - 0x30);
-		} while (idx < _len && std::isdigit(_equation[idx]));
+			d = 10 * d + (ctx.equation[idx++] - 0x30);
+		} while (idx < ctx.len && std::isdigit(ctx.equation[idx]));
 
 		return d;
 	}
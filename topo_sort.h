@@ -1,53 +1,94 @@
 #pragma once
 #include <vector>
-#include <unordered_map>
 #include <variant>
+#include <utility>
 
 #include "errors.h"
+#include "dependency_graph.h"
 
 namespace solver {
+	// Kahn's algorithm over csr graph where edge i -> j means i depends on j, so j is ordered first.
+	// iterative with flat arrays, O(V+E) time and memory for any depth of dependency chains
 	class topo_sort {
-		enum class status { init, temp, done };
+		static constexpr size_t not_visited = static_cast<size_t>(-1);
 
-		std::vector<std::vector<size_t>> _graph;
+		csr_graph _graph;
 		std::vector<size_t> _order;
-
-		std::unordered_map<size_t, status> vert_status;
+		std::vector<size_t> _levels;
+		std::vector<size_t> _cycle;
 	public:
-		topo_sort(std::vector<std::vector<size_t>> graph) : _graph(std::move(graph)) {}
+		explicit topo_sort(csr_graph graph) : _graph(std::move(graph)) {}
+
+		// hands sorted graph on, sort() is not valid afterwards
+		[[nodiscard]] csr_graph release_graph() { return std::move(_graph); }
 
 		std::variant<std::vector<size_t>, defs::error> sort() {
-			// fill vert_status
 			const size_t n_vert = _graph.size();
-			for (size_t i = 0; i < n_vert; ++i)
-				vert_status[i] = status::init;
 
-			// run algo
+			// reversed edges: j -> vertices depending on j
+			std::vector<size_t> rev_offsets(n_vert + 1, 0);
+			for (const size_t j : _graph.targets) ++rev_offsets[j + 1];
+			for (size_t i = 0; i < n_vert; ++i) rev_offsets[i + 1] += rev_offsets[i];
+			std::vector<size_t> rev_targets(_graph.n_edges());
+			std::vector<size_t> fill(rev_offsets.begin(), rev_offsets.end() - 1);
+			for (size_t i = 0; i < n_vert; ++i) {
+				for (const size_t j : _graph[i])
+					rev_targets[fill[j]++] = i;
+			}
+
+			// _order doubles as fifo queue of vertices with all dependencies done
+			std::vector<size_t> pending(n_vert);
+			_order.clear();
+			_order.reserve(n_vert);
+			_levels.assign(n_vert, 0);
 			for (size_t i = 0; i < n_vert; ++i) {
-				if (vert_status[i] == status::done) continue;
-				if (visit(i)) {
-					return defs::error::graph_cycle;
+				pending[i] = _graph[i].size();
+				if (pending[i] == 0) _order.push_back(i);
+			}
+			for (size_t head = 0; head < _order.size(); ++head) {
+				const size_t j = _order[head];
+				for (size_t k = rev_offsets[j]; k < rev_offsets[j + 1]; ++k) {
+					const size_t i = rev_targets[k];
+					if (_levels[i] < _levels[j] + 1) _levels[i] = _levels[j] + 1;
+					if (--pending[i] == 0) _order.push_back(i);
 				}
 			}
 
+			if (_order.size() != n_vert) {
+				find_cycle(pending);
+				return defs::error::graph_cycle;
+			}
 			return _order;
 		}
 
-		// true means there is a cycle
-		bool visit(const size_t n) {
-			if (vert_status[n] == status::done) return false;
-			if (vert_status[n] == status::temp) return true;
+		// level of every vertex: 0 without dependencies, otherwise 1 + highest level of its dependencies.
+		// vertices of one level do not depend on each other
+		[[nodiscard]] const std::vector<size_t>& levels() const { return _levels; }
 
-			vert_status[n] = status::temp;
-			for (size_t i = 0, sz = _graph[n].size(); i < sz; ++i) {
-				if (visit(_graph[n][i]))
-					return true;
-			}
+		// after graph_cycle: vertices of one cycle, each depends on the next and last one on the first
+		[[nodiscard]] const std::vector<size_t>& cycle() const { return _cycle; }
 
-			vert_status[n] = status::done;
-			_order.push_back(n);
-			return false;
+	private:
+		// every vertex left with pending dependencies has at least one unsorted dependency,
+		// so walking them from any such vertex has to come back to a vertex of the walk
+		void find_cycle(const std::vector<size_t>& pending) {
+			_cycle.clear();
+			std::vector<size_t> pos(pending.size(), not_visited); // position of vertex in walk
+			std::vector<size_t> walk;
+			size_t v = 0;
+			while (pending[v] == 0) ++v;
+			while (pos[v] == not_visited) {
+				pos[v] = walk.size();
+				walk.push_back(v);
+				for (const size_t j : _graph[v]) {
+					if (pending[j] != 0) {
+						v = j;
+						break;
+					}
+				}
+			}
+			_cycle.assign(walk.begin() + static_cast<std::ptrdiff_t>(pos[v]), walk.end());
 		}
 	};
 
-}
\ No newline at end of file
+}
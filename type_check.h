@@ -0,0 +1,101 @@
+#pragma once
+#include <vector>
+#include <variant>
+#include <span>
+#include <memory_resource>
+
+#include "maps.h"
+
+namespace solver
+{
+	// resolves operator, function or constant of postfix token to its action
+	[[nodiscard]] static std::variant<Term, error> resolve_term(const lex_wrapper& lw) {
+		if (lw.lex_type == lex::number)
+			return Term{ lw.number() };
+		if (lw.lex_type == lex::boolean)
+			return Term{ lw.boolean() };
+		if (lw.lex_type == lex::variable)
+			return Term{ num_t{ 0 } }; // variables are always numbers
+		if (lw.lex_type == lex::constant) {
+			const auto it = const_map.find(lw.name());
+			if (it == const_map.end()) return error::unknown_token;
+			return it->second;
+		}
+		if (is_operator(lw.lex_type)) {
+			const auto it = op_map.find(lw.lex_type);
+			if (it == op_map.end()) return error::bad_operator;
+			return it->second;
+		}
+		if (lw.lex_type == lex::function) {
+			const auto it = func_map.find(lw.name());
+			if (it == func_map.end()) return error::unknown_token;
+			return it->second;
+		}
+		return error::unknown_token;
+	}
+
+	// tokens of postfix which produce no value (begin, end, braces)
+	constexpr bool is_postfix_noop(const lex l) {
+		return l == lex::begin || l == lex::end || l == lex::lb || l == lex::rb || l == lex::comma || l == lex::space || l == lex::unary_plus;
+	}
+
+	// static type checking of postfix program.
+	// returns type of value produced by every token (no-op tokens get num), or error if program is ill-typed
+	[[nodiscard]] static std::variant<std::pmr::vector<value_type>, error> infer_types(std::span<const lex_wrapper> postfix,
+		std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+		std::pmr::vector<value_type> types(postfix.size(), value_type::num, mr);
+		std::pmr::vector<value_type> st(mr);
+
+		for (size_t idx = 0, n = postfix.size(); idx < n; ++idx) {
+			const auto& lw = postfix[idx];
+			if (is_postfix_noop(lw.lex_type)) continue;
+
+			const auto term = resolve_term(lw);
+			if (term.index() == 1) return std::get<error>(term);
+			const size_t kind = std::get<Term>(term).index();
+
+			const size_t n_args = kind <= 1 ? 0 : lw.n_args;
+			if (kind > 1) {
+				// only min and max take variable number of arguments
+				const bool multi = lw.lex_type == lex::function && is_multi_arg_funcs(lw.name());
+				if (multi ? n_args < 1 : n_args != term_args.at(kind))
+					return error::wrong_args_count;
+			}
+			if (st.size() < n_args) return error::wrong_args_count;
+
+			// arguments in call order
+			const auto args = st.end() - static_cast<std::ptrdiff_t>(n_args);
+			const auto all_of = [&](const value_type t) { return std::all_of(args, st.end(), [t](const value_type a) { return a == t; }); };
+
+			value_type ret = value_type::num;
+			switch (kind) {
+				case 0: ret = value_type::num; break;
+				case 1: ret = value_type::boolean; break;
+				case 2: case 3:
+					if (!all_of(value_type::num)) return error::wrong_type;
+					break;
+				case 4:
+					if (args[0] != value_type::boolean || args[1] != value_type::num || args[2] != value_type::num)
+						return error::wrong_type;
+					break;
+				case 5:
+					if (!all_of(value_type::num)) return error::wrong_type;
+					ret = value_type::boolean;
+					break;
+				case 6:
+					if (!all_of(value_type::boolean)) return error::wrong_type;
+					ret = value_type::boolean;
+					break;
+				default: // constants
+					break;
+			}
+
+			st.erase(args, st.end());
+			st.push_back(ret);
+			types[idx] = ret;
+		}
+
+		if (st.size() != 1) return error::wrong_args_count;
+		return types;
+	}
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <span>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "common_types.h"
+
+namespace solver::vm
+{
+	// n[] are number registers, b[] are boolean registers, v[] are variable slots
+	enum class op_code : unsigned char {
+		ld_const, // n[dst] = imm
+		ld_var,   // n[dst] = v[a]
+		ld_bool,  // b[dst] = imm != 0
+		neg,      // n[dst] = -n[a]
+		add,      // n[dst] = n[a] + n[b]
+		sub,      // n[dst] = n[a] - n[b]
+		mul,      // n[dst] = n[a] * n[b]
+		div,      // n[dst] = n[a] / n[b]
+		add_rc,   // n[dst] = n[a] + imm
+		sub_rc,   // n[dst] = n[a] - imm
+		sub_cr,   // n[dst] = imm - n[a]
+		mul_rc,   // n[dst] = n[a] * imm
+		div_rc,   // n[dst] = n[a] / imm
+		div_cr,   // n[dst] = imm / n[a]
+		add_vc,   // n[dst] = v[a] + imm
+		sub_vc,   // n[dst] = v[a] - imm
+		sub_cv,   // n[dst] = imm - v[a]
+		mul_vc,   // n[dst] = v[a] * imm
+		div_vc,   // n[dst] = v[a] / imm
+		div_cv,   // n[dst] = imm / v[a]
+		fma,      // n[dst] = n[a] * n[b] + n[c]
+		sqrt,     // n[dst] = half_power(n[a])
+		min,      // n[dst] = std::min(n[a], n[b]) without call and branch
+		max,      // n[dst] = std::max(n[a], n[b]) without call and branch
+		call0,    // n[dst] = f0()
+		call1,    // n[dst] = f1(n[a])
+		call1_v,  // n[dst] = f1(v[a])
+		call2,    // n[dst] = f2(n[a], n[b])
+		lt,       // b[dst] = n[a] < n[b]
+		le,       // b[dst] = n[a] <= n[b]
+		gt,       // b[dst] = n[a] > n[b]
+		ge,       // b[dst] = n[a] >= n[b]
+		eq,       // b[dst] = n[a] == n[b]
+		logic_and, // b[dst] = b[a] && b[b]
+		logic_or,  // b[dst] = b[a] || b[b]
+		logic_xor, // b[dst] = b[a] != b[b]
+		select,    // n[dst] = b[a] ? n[b] : n[c]
+		select_lt, // n[dst] = n[a] < n[b] ? n[c] : n[e]
+		select_le, // n[dst] = n[a] <= n[b] ? n[c] : n[e]
+		select_gt, // n[dst] = n[a] > n[b] ? n[c] : n[e]
+		select_ge, // n[dst] = n[a] >= n[b] ? n[c] : n[e]
+		select_eq, // n[dst] = n[a] == n[b] ? n[c] : n[e]
+		mov,       // n[dst] = n[a]
+		bmov,      // b[dst] = b[a]
+		jump,      // continue at c
+		jump_if,     // continue at c if b[a]
+		jump_unless, // continue at c if !b[a]
+		jump_nlt,  // continue at c if !(n[a] < n[b])
+		jump_nle,  // continue at c if !(n[a] <= n[b])
+		jump_ngt,  // continue at c if !(n[a] > n[b])
+		jump_nge,  // continue at c if !(n[a] >= n[b])
+		jump_neq,  // continue at c if !(n[a] == n[b])
+	};
+
+	// function of call instructions, named so designated initializers may leave it out
+	union callee {
+		num_empty_t f0{ nullptr };
+		num_1num_t f1;
+		num_2num_t f2;
+	};
+
+	struct instruction {
+		op_code code{ op_code::ld_const };
+		uint32_t dst{ 0 }, a{ 0 }, b{ 0 }, c{ 0 }, e{ 0 };
+		num_t imm{ 0 };
+		callee fn{};
+	};
+
+	// instruction reads v[a]
+	[[nodiscard]] constexpr bool reads_variable(const op_code c) {
+		switch (c) {
+			case op_code::ld_var: case op_code::add_vc: case op_code::sub_vc: case op_code::sub_cv:
+			case op_code::mul_vc: case op_code::div_vc: case op_code::div_cv: case op_code::call1_v:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	[[nodiscard]] constexpr bool is_call(const op_code c) {
+		return c == op_code::call0 || c == op_code::call1 || c == op_code::call1_v || c == op_code::call2;
+	}
+
+	// x^0.5 through sqrt, equal to pow also where plain sqrt is not: +0 for -0 and +inf for -inf
+	[[nodiscard]] inline num_t half_power(const num_t x) {
+		return x == -std::numeric_limits<num_t>::infinity() ? std::numeric_limits<num_t>::infinity() : std::sqrt(x + num_t{ 0 });
+	}
+
+	// register file, reused between evaluations so running a program allocates nothing
+	class registers {
+		std::unique_ptr<num_t[]> _num;
+		std::unique_ptr<bool_t[]> _bool;
+		size_t _num_size{ 0 };
+		size_t _bool_size{ 0 };
+
+	public:
+		void reserve(const size_t n_num, const size_t n_bool) {
+			if (n_num > _num_size) {
+				_num = std::make_unique_for_overwrite<num_t[]>(n_num);
+				_num_size = n_num;
+			}
+			if (n_bool > _bool_size) {
+				_bool = std::make_unique_for_overwrite<bool_t[]>(n_bool);
+				_bool_size = n_bool;
+			}
+		}
+
+		[[nodiscard]] num_t* num() const { return _num.get(); }
+		[[nodiscard]] bool_t* boolean() const { return _bool.get(); }
+	};
+
+	inline void execute(std::span<const instruction> program, const num_t* v, num_t* n, bool_t* b) {
+		const instruction* const begin = program.data();
+		const instruction* const end = begin + program.size();
+		for (const instruction* ip = begin; ip != end;) {
+			const instruction& i = *ip++;
+			switch (i.code) {
+				case op_code::ld_const:  n[i.dst] = i.imm; break;
+				case op_code::ld_var:    n[i.dst] = v[i.a]; break;
+				case op_code::ld_bool:   b[i.dst] = i.imm != num_t{ 0 }; break;
+				case op_code::neg:       n[i.dst] = -n[i.a]; break;
+				case op_code::add:       n[i.dst] = n[i.a] + n[i.b]; break;
+				case op_code::sub:       n[i.dst] = n[i.a] - n[i.b]; break;
+				case op_code::mul:       n[i.dst] = n[i.a] * n[i.b]; break;
+				case op_code::div:       n[i.dst] = n[i.a] / n[i.b]; break;
+				case op_code::add_rc:    n[i.dst] = n[i.a] + i.imm; break;
+				case op_code::sub_rc:    n[i.dst] = n[i.a] - i.imm; break;
+				case op_code::sub_cr:    n[i.dst] = i.imm - n[i.a]; break;
+				case op_code::mul_rc:    n[i.dst] = n[i.a] * i.imm; break;
+				case op_code::div_rc:    n[i.dst] = n[i.a] / i.imm; break;
+				case op_code::div_cr:    n[i.dst] = i.imm / n[i.a]; break;
+				case op_code::add_vc:    n[i.dst] = v[i.a] + i.imm; break;
+				case op_code::sub_vc:    n[i.dst] = v[i.a] - i.imm; break;
+				case op_code::sub_cv:    n[i.dst] = i.imm - v[i.a]; break;
+				case op_code::mul_vc:    n[i.dst] = v[i.a] * i.imm; break;
+				case op_code::div_vc:    n[i.dst] = v[i.a] / i.imm; break;
+				case op_code::div_cv:    n[i.dst] = i.imm / v[i.a]; break;
+				case op_code::fma:       n[i.dst] = std::fma(n[i.a], n[i.b], n[i.c]); break;
+				case op_code::sqrt:      n[i.dst] = half_power(n[i.a]); break;
+				case op_code::min:       n[i.dst] = n[i.b] < n[i.a] ? n[i.b] : n[i.a]; break;
+				case op_code::max:       n[i.dst] = n[i.a] < n[i.b] ? n[i.b] : n[i.a]; break;
+				case op_code::call0:     n[i.dst] = i.fn.f0(); break;
+				case op_code::call1:     n[i.dst] = i.fn.f1(n[i.a]); break;
+				case op_code::call1_v:   n[i.dst] = i.fn.f1(v[i.a]); break;
+				case op_code::call2:     n[i.dst] = i.fn.f2(n[i.a], n[i.b]); break;
+				case op_code::lt:        b[i.dst] = n[i.a] < n[i.b]; break;
+				case op_code::le:        b[i.dst] = n[i.a] <= n[i.b]; break;
+				case op_code::gt:        b[i.dst] = n[i.a] > n[i.b]; break;
+				case op_code::ge:        b[i.dst] = n[i.a] >= n[i.b]; break;
+				case op_code::eq:        b[i.dst] = n[i.a] == n[i.b]; break;
+				case op_code::logic_and: b[i.dst] = b[i.a] && b[i.b]; break;
+				case op_code::logic_or:  b[i.dst] = b[i.a] || b[i.b]; break;
+				case op_code::logic_xor: b[i.dst] = b[i.a] != b[i.b]; break;
+				case op_code::select:    n[i.dst] = b[i.a] ? n[i.b] : n[i.c]; break;
+				case op_code::select_lt: n[i.dst] = n[i.a] < n[i.b] ? n[i.c] : n[i.e]; break;
+				case op_code::select_le: n[i.dst] = n[i.a] <= n[i.b] ? n[i.c] : n[i.e]; break;
+				case op_code::select_gt: n[i.dst] = n[i.a] > n[i.b] ? n[i.c] : n[i.e]; break;
+				case op_code::select_ge: n[i.dst] = n[i.a] >= n[i.b] ? n[i.c] : n[i.e]; break;
+				case op_code::select_eq: n[i.dst] = n[i.a] == n[i.b] ? n[i.c] : n[i.e]; break;
+				case op_code::mov:       n[i.dst] = n[i.a]; break;
+				case op_code::bmov:      b[i.dst] = b[i.a]; break;
+				case op_code::jump:      ip = begin + i.c; break;
+				case op_code::jump_if:     if (b[i.a]) ip = begin + i.c; break;
+				case op_code::jump_unless: if (!b[i.a]) ip = begin + i.c; break;
+				case op_code::jump_nlt:  if (!(n[i.a] < n[i.b])) ip = begin + i.c; break;
+				case op_code::jump_nle:  if (!(n[i.a] <= n[i.b])) ip = begin + i.c; break;
+				case op_code::jump_ngt:  if (!(n[i.a] > n[i.b])) ip = begin + i.c; break;
+				case op_code::jump_nge:  if (!(n[i.a] >= n[i.b])) ip = begin + i.c; break;
+				case op_code::jump_neq:  if (!(n[i.a] == n[i.b])) ip = begin + i.c; break;
+			}
+		}
+	}
+}